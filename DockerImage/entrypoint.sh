@@ -0,0 +1,19 @@
+#!/bin/sh
+#
+# entrypoint.sh — run the matrix tool on every profile prepared at build time ($PROFILES).
+# With one profile the outputs go to /app/results, with several to /app/results/<profile>.
+# Extra arguments are passed on to the binary.
+#
+set -e
+
+ARGS="--algorithm ${ALGORITHM:-ch}"
+for profile in ${PROFILES:-car}; do
+  ARGS="$ARGS --osrm-path $profile=/app/OSM/$profile/region.osrm"
+done
+
+# Without a coordinates file the tool samples locations
+if [ -f /app/results/coordinates.txt ]; then
+  ARGS="$ARGS --coordinates-path /app/results/coordinates.txt"
+fi
+
+exec /app/build/osrm $ARGS "$@"
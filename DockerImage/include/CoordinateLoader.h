@@ -0,0 +1,30 @@
+#ifndef COORDINATE_LOADER_H
+#define COORDINATE_LOADER_H
+
+// std libs
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+// On-disk layouts understood by the coordinate loader
+enum class CoordinateFormat {
+    Auto,   // decided from the file extension (.f64 / .bin -> Float64, .f32 -> Float32, anything else -> Text)
+    Text,   // one "<longitude> <latitude>" pair per line, whitespace separated
+    Float64, // raw native-endian doubles: lon0 lat0 lon1 lat1 ...
+    Float32  // raw native-endian floats:  lon0 lat0 lon1 lat1 ...
+};
+
+// Parse a format name given on the command line ("auto", "text", "f64", "f32").
+// Returns false if the name is unknown.
+bool parse_coordinate_format(const std::string &name, CoordinateFormat &format);
+
+// Load (longitude, latitude) pairs from `file` into `coordinates`.
+// Text files are memory mapped, split into newline-aligned chunks and parsed in parallel
+// with std::from_chars. Malformed lines are skipped and reported with their line number.
+// Binary files are copied straight out of the mapping without any parsing.
+// Returns true on success, false if the file could not be opened/mapped or has an invalid size.
+bool load_coordinates(const std::string &file, std::vector<std::pair<double, double>> &coordinates,
+                      CoordinateFormat format = CoordinateFormat::Auto, int num_threads = 1);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef DIAGNOSTIC_LOG_H
+#define DIAGNOSTIC_LOG_H
+
+// std libs
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Thread-safe, rate-limited diagnostics for hot loops. Only the first `limit` messages of every category
+// are kept; they are buffered and written to std::cerr in one go by flush(), so the workers never take the
+// stream lock. Messages beyond the limit are only counted, and reported by flush().
+//
+//     if (log.admit(category)) log.write("...");
+class DiagnosticLog {
+public:
+    explicit DiagnosticLog(int categories, int limit = 10) : limit_(limit), counts_(categories) {}
+
+    // Count a message of `category`, returns true if it is still under the limit and should be written
+    bool admit(int category) { return counts_[category].fetch_add(1, std::memory_order_relaxed) < static_cast<uint64_t>(limit_); }
+
+    // Buffer an admitted message
+    void write(const std::string &message) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        buffer_ += message;
+        buffer_ += '\n';
+    }
+
+    uint64_t count(int category) const { return counts_[category].load(std::memory_order_relaxed); }
+
+    // Write the buffered messages and a line per category for the suppressed ones
+    template <typename NameFn>
+    void flush(NameFn category_name) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::cerr << buffer_;
+        buffer_.clear();
+        for (size_t c = 0; c < counts_.size(); ++c) {
+            const uint64_t n = counts_[c].load(std::memory_order_relaxed);
+            if (n > static_cast<uint64_t>(limit_)) {
+                std::cerr << "... " << n - limit_ << " more '" << category_name(static_cast<int>(c)) << "' messages suppressed" << std::endl;
+            }
+        }
+    }
+
+private:
+    int limit_;
+    std::vector<std::atomic<uint64_t>> counts_;
+    std::mutex mutex_;
+    std::string buffer_;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef MATRIX_ENGINE_H
+#define MATRIX_ENGINE_H
+
+// project libs
+#include "DiagnosticLog.h"
+#include "RouteStatus.h"
+
+// osrm libs
+#include "osrm/engine_config.hpp"
+#include "osrm/osrm.hpp"
+#include "osrm/route_parameters.hpp"
+
+// std libs
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Straight line (great circle) distance in meters between two points given in degrees
+double haversine(double lat1, double lon1, double lat2, double lon2);
+
+// In-process travel time and distance matrices on one OSRM dataset, the core of the osrm_matrix library.
+// Load the dataset once, then compute M x N matrices into caller-provided buffers; no files are written.
+// Several threads may call route() and compute() concurrently on one engine, and the configuration setters
+// may be called at any time: the fallback policy is an immutable snapshot swapped atomically (a compute()
+// already running keeps the policy it started with) and the thread default is atomic.
+//
+//     MatrixEngine engine;
+//     if (!engine.load("car.osrm")) return;
+//     engine.compute(origins, m, destinations, n, durations, distances);
+//
+// Coordinates are interleaved lon/lat pairs in degrees. Cells OSRM can't route get the estimate of the
+// fallback policy, the optional status buffer tells which (route_status).
+class MatrixEngine {
+public:
+    MatrixEngine() = default;
+    MatrixEngine(const MatrixEngine &) = delete;
+    MatrixEngine &operator=(const MatrixEngine &) = delete;
+
+    // Load the .osrm base file at `path`, prepared for `algorithm` (CH: extract + contract, MLD: extract +
+    // partition + customize). Returns false, and reports the reason on std::cerr, if the dataset can't be loaded.
+    bool load(const std::string &path, osrm::EngineConfig::Algorithm algorithm = osrm::EngineConfig::Algorithm::CH);
+    bool loaded() const { return engine_ != nullptr; }
+
+    // Fallback estimates for cells OSRM can't route
+    void set_fallback(const fallback_policy &policy) { std::atomic_store(&fallback_, std::make_shared<const fallback_policy>(policy)); }
+    fallback_policy fallback() const { return *std::atomic_load(&fallback_); }
+
+    // Default number of compute() threads, 0 means one per available CPU
+    void set_threads(int threads) { threads_ = threads; }
+
+    // The underlying OSRM engine, for the other services (Nearest, full Route, ...)
+    const osrm::OSRM &osrm() const { return *engine_; }
+    const osrm::EngineConfig &config() const { return config_; }
+
+    // Route one pair and store the road distance (m) and duration (s). Failed or empty routes get the fallback
+    // estimate. Returns the route status; unexpected cases are reported through `log` (one category per status).
+    // `params` is scratch space of the calling thread, reused between calls.
+    uint8_t route(osrm::RouteParameters &params, const double *from, const double *to, DiagnosticLog &log, int &distance, int &time) const;
+
+    // Durations (s) and distances (m) from each of the `m` origins to each of the `n` destinations, row-major
+    // m x n int32 buffers; pass nullptr for an output that isn't needed. `status` (optional) receives the
+    // route_status of every cell. Uses `threads` workers (0: the set_threads() default). Returns false if
+    // the engine isn't loaded or the arguments are invalid.
+    bool compute(const double *origins, int m, const double *destinations, int n, int32_t *durations, int32_t *distances,
+                 uint8_t *status = nullptr, int threads = 0) const;
+
+private:
+    // route() with the fallback policy snapshot `policy`
+    uint8_t route(osrm::RouteParameters &params, const double *from, const double *to, DiagnosticLog &log, const fallback_policy &policy,
+                  int &distance, int &time) const;
+
+    osrm::EngineConfig config_;
+    std::unique_ptr<osrm::OSRM> engine_;
+    std::shared_ptr<const fallback_policy> fallback_ = std::make_shared<const fallback_policy>();
+    std::atomic<int> threads_{0};
+};
+
+#endif
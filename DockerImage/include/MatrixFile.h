@@ -0,0 +1,73 @@
+#ifndef MATRIX_FILE_H
+#define MATRIX_FILE_H
+
+// std libs
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Pipeline.h"
+#include "TravelMatrix.h"
+
+// Binary matrix file layout (all integers native-endian, i.e. little-endian on the supported hosts):
+//   header      : matrix_file_header
+//   raw         : rows * cols codes of bits / 8 bytes, row-major (mmap friendly, O(1) row access)
+//   compressed  : uint64 block offsets[blocks + 1] (relative to the first block), followed by the blocks.
+//                 A block holds `block_rows` rows; each row is stored as the zigzag varint deltas of its
+//                 codes against the previous row of the block (the first row against zeros), and the
+//                 block is zstd compressed. Reading a row only decompresses its block.
+// Codes are the TravelMatrix codes: value = code * unit, the largest code marks an unset cell.
+// Symmetric matrices (MATRIX_FILE_TRIANGLE) only store the packed upper triangle: row i holds columns i..cols-1.
+struct matrix_file_header {
+    char magic[8] = {'O', 'S', 'R', 'M', 'M', 'A', 'T', '1'};
+    uint32_t rows = 0;
+    uint32_t cols = 0;
+    uint32_t bits = 32;
+    uint32_t flags = 0; // MATRIX_FILE_COMPRESSED | MATRIX_FILE_TRIANGLE
+    double unit = 1.0;
+    uint32_t block_rows = 0;
+    uint32_t reserved = 0;
+};
+
+#define MATRIX_FILE_COMPRESSED 1u
+#define MATRIX_FILE_TRIANGLE 2u
+
+// Whether this build can write/read compressed matrix files (zstd found at configure time)
+bool matrix_file_compression_available();
+
+// Write `matrix` to `filename`, raw or row-delta + zstd compressed. Rows are written in order, each after
+// `wait_row` says it is complete, so the file can be streamed while the matrix is still being routed.
+// Returns false on failure.
+bool write_matrix_file(const std::string &filename, const TravelMatrix &matrix, bool compressed, const row_wait_fn &wait_row = {});
+
+// Random row access to a matrix file written by write_matrix_file
+class MatrixFileReader {
+public:
+    bool open(const std::string &filename);
+
+    const matrix_file_header &header() const { return header_; }
+    int rows() const { return static_cast<int>(header_.rows); }
+    int cols() const { return static_cast<int>(header_.cols); }
+
+    // Read row i as values (seconds or meters, TravelMatrix::UNSET for unset cells).
+    // For a triangle file the columns left of the diagonal are gathered from the rows above.
+    bool read_row(int i, std::vector<int> &row);
+
+private:
+    bool load_block(uint32_t block);
+
+    // Number of stored cells in row i and the code of stored cell (i, j)
+    uint32_t stored_cols(uint32_t i) const { return header_.flags & MATRIX_FILE_TRIANGLE ? header_.cols - i : header_.cols; }
+    bool stored_code(uint32_t i, uint32_t j, uint32_t &code);
+
+    std::ifstream in_;
+    matrix_file_header header_;
+    std::vector<uint64_t> offsets_;
+    uint64_t data_start_ = 0;
+    int64_t cached_block_ = -1;
+    std::vector<uint32_t> block_codes_;  // decoded codes of the cached block
+    std::vector<uint64_t> block_starts_; // index in block_codes_ of every row of the cached block
+};
+
+#endif
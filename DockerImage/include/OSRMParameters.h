@@ -1,11 +1,24 @@
 #ifndef OSRM_PARAMS_H
 #define OSRM_PARAMS_H
 
+// project libs
+#include "CoordinateLoader.h"
+#include "MatrixEngine.h"
+#include "Numa.h"
+#include "Polygon.h"
+#include "RouteStatus.h"
+#include "Sampling.h"
+#include "SpaceFillingCurve.h"
+#include "TableFile.h"
+#include "Threads.h"
+#include "TimeSlices.h"
+#include "TravelMatrix.h"
+
 // osrm libs
 #include "osrm/engine_config.hpp"
-#include "osrm/osrm.hpp"
 
 // std libs
+#include <cstdint>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -18,68 +31,247 @@
 #include <functional>
 #include <filesystem>
 #include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+
+// One routing dataset (profile) with its own engine and result matrices.
+// Several datasets share the coordinates, the haversine pass and the worker threads of one run.
+struct osrm_dataset {
+    std::string name = "";            // Label of the dataset (e.g. 'car'), used as prefix for its output files
+    std::string pathTo_OSM_data = ""; // Path to the .osrm base file of this dataset
+
+    // Routing speed up technique the dataset was prepared for
+    osrm::EngineConfig::Algorithm algorithm = osrm::EngineConfig::Algorithm::CH;
+
+    std::unique_ptr<MatrixEngine> engine; // Matrix engine of this dataset (pointer)
+    std::vector<std::unique_ptr<MatrixEngine>> replicas; // Per NUMA node copies of the engine, replicas[n] for node n > 0 (optional)
+
+    TravelMatrix TravelTimes;     // Travel times between needed locations
+    TravelMatrix TravelDistances; // Travel distances between needed locations
+    RouteStatusMatrix RouteStatus; // How every cell was obtained (route_status)
+
+    // Constructor
+    osrm_dataset(const std::string &name, const std::string &path, osrm::EngineConfig::Algorithm algorithm)
+        : name(name), pathTo_OSM_data(path), algorithm(algorithm) {};
+
+    // Destructor
+    ~osrm_dataset() {
+        // Reset engine unique_ptr to release OSRM internal resources before static destructors run
+        replicas.clear();
+        if (engine) {
+            engine.reset();
+        }
+    }
+
+    // Free the engine and its replicas, e.g. before other processes load the dataset
+    void release_engines() {
+        replicas.clear();
+        engine.reset();
+    }
+
+    // Allocate the rows x cols result matrices, all cells unset
+    bool allocate_matrices(int rows, int cols, const matrix_encoding &timeEncoding, const matrix_encoding &distanceEncoding, bool triangle = false) {
+        RouteStatus.allocate(rows, cols, triangle);
+        return TravelTimes.allocate(rows, cols, timeEncoding, triangle) && TravelDistances.allocate(rows, cols, distanceEncoding, triangle);
+    }
+
+    // Engine for workers running on NUMA node `node`: its replica if one was loaded, else the engine
+    const MatrixEngine &engine_for(int node) const {
+        return node > 0 && node < static_cast<int>(replicas.size()) && replicas[node] ? *replicas[node] : *engine;
+    }
+
+    // Load the dataset into a new engine, failed routes get the estimates of `fallback`
+    bool start_engine(const fallback_policy &fallback) {
+        engine = std::make_unique<MatrixEngine>();
+        engine->set_fallback(fallback);
+        return engine->load(pathTo_OSM_data, algorithm);
+    }
+
+    // Load the dataset once more for NUMA node `node` (> 0). Call from a thread pinned to that node:
+    // the graph pages are first touched there, so the kernel places them in the node's memory.
+    bool start_replica(int node) {
+        auto replica = std::make_unique<MatrixEngine>();
+        replica->set_fallback(engine->fallback());
+        if (!replica->load(pathTo_OSM_data, algorithm)) return false;
+        static std::mutex replicas_mutex;
+        std::lock_guard<std::mutex> lock(replicas_mutex);
+        if (static_cast<int>(replicas.size()) <= node) replicas.resize(node + 1);
+        replicas[node] = std::move(replica);
+        return true;
+    }
+};
 
 struct osrm_params {
     // ---------------------------------------------------------- OSRM VARS ----------------------------------------------------
-    std::string pathTo_OSM_data = ""; // Path to OSRM data (if given in argument, this is overridden)
     std::string pathTO_coordinates = ""; // Path to coordinates (if given in argument, this is overridden)
+    CoordinateFormat coordinates_format = CoordinateFormat::Auto; // Layout of the coordinates file (text or binary)
 
-    osrm::EngineConfig config;          // Global Osrm configuration
-    std::unique_ptr<osrm::OSRM> engine; // Global Osrm engine (pointer)
+    // Datasets to route on (one per profile, e.g. car, bicycle and foot), each with its own engine and matrices
+    std::vector<std::unique_ptr<osrm_dataset>> datasets;
+    osrm::EngineConfig::Algorithm algorithm = osrm::EngineConfig::Algorithm::CH; // Algorithm of datasets added from now on
 
-    int max_threads = 1;                           // maximum number of threads, will be determined later, initialized at 1
+    // Time slices (e.g. peak/offpeak): the single MLD dataset is re-customised once per slice with its own
+    // speed/turn penalty files and every slice is routed as a separate dataset
+    std::vector<time_slice> time_slices;
+    std::string customize_binary = "osrm-customize"; // osrm-customize executable used for time slices
+
+    int max_threads = 0;                           // routing (compute bound) threads, 0 until configure_threads() ran
+    int write_threads = 0;                         // output writing (I/O bound) threads
+    std::vector<int> affinity;                     // CPUs the routing threads are pinned to, one per thread round robin (optional)
     const int equal_max_distance_havesine = 100; // Max haversine distance we consider two coordinates to be the same place
 
     int Number_of_locations = 0; // Number of locations
-    int **TravelTimes = nullptr;       // Travel times between needed locations
-    int **TravelDistances = nullptr;   // Travel distances between needed locations
+
+    // Storage of the travel matrices (bits per cell and unit); 32 bits with 1 s / 1 m units by default
+    matrix_encoding time_encoding;
+    matrix_encoding distance_encoding;
+
+    // NUMA placement: pin the routing workers per node, and optionally route on one engine replica per node
+    bool numa = false;
+    bool numa_replicas = false;
+    std::vector<numa_node> numa_nodes; // Detected when the engines start, if numa is set
+    int numa_benchmark_pairs = 0;      // If > 0, only benchmark routing this many pairs on 1..all nodes
+    int thread_benchmark_pairs = 0;    // If > 0, only benchmark routing this many pairs on 1..max_threads threads
+
+    // Count hardware events (instructions, cycles, cache and dTLB misses) of the routing and csv writing threads
+    bool perf_counters = false;
+
+    // Order in which the routing workers visit the rows and columns; the matrices keep the location indices
+    curve_type route_curve = curve_type::None;
+    int reorder_benchmark_pairs = 0; // If > 0, only benchmark routing this many pairs in file and curve order
+
+    // Symmetric approximation: only route pairs i < j and mirror them, the matrices store a packed triangle
+    bool symmetric = false;
+    int symmetric_audit_samples = 0; // Number of reverse pairs routed to report the asymmetry error
+
+    // Cluster approximation (see ClusterMatrix.h): route K centroids and the access legs instead of all pairs
+    int approximate_clusters = 0;         // K, 0: exact matrices
+    int approximate_audit_samples = 1000; // Number of random pairs routed exactly to report the approximation error
+
+    // Circuity model (see CircuityModel.h): fill the matrices with estimates fitted from a routed sample
+    int circuity_samples = 0;          // Stratified sample pairs, 0: routed matrices
+    int circuity_audit_samples = 1000; // Held-out pairs routed to report the error of the estimates
+    int circuity_grid = 4;             // Region grid cells per side
+
+    // Streaming reductions: every routed row is folded into per-row results instead of being stored
+    int reduce_nearest = 0;         // If > 0, keep the k nearest destinations (by time) of every location
+    bool reduce_stats = false;      // Per-row min, mean, percentiles and max of the times and distances
+    int reduce_histogram_bins = 0;  // If > 0, per-row histogram of the times
+    double reduce_histogram_width = 600; // Seconds per histogram bin, the last bin also counts everything beyond
+    std::string pathTO_destinations;                        // Destinations (e.g. depots) file, all locations if empty
+    std::vector<std::pair<double, double>> destinations;    // Loaded from pathTO_destinations (longitude, latitude)
+
+    // Batch jobs (see Manifest.h): many coordinate sets routed against the datasets loaded once
+    std::string manifest_path;
+
+    // Budget planner (see Planner.h): fit the run into a memory limit and a deadline, or only print the plan
+    size_t memory_limit = 0;        // Bytes, 0: no limit
+    double deadline = 0;            // Seconds, 0: no deadline
+    bool plan_only = false;
+    bool encoding_explicit = false; // --matrix-bits or a unit was given, the planner keeps the encoding
+
+    // Sparse mode: only pairs within a travel time and/or distance budget are kept (0: no budget)
+    double max_duration = 0; // Seconds
+    double max_distance = 0; // Meters
+    double max_speed = 130.0 / 3.6; // Meters per second, upper bound of the profile's speed used to prune pairs
+
+    std::string output_dir = "results"; // Directory the output files are written to
+
+    // Snap pre-flight: every location is snapped once before routing if max_snap_distance > 0
+    double max_snap_distance = 0;  // Meters, locations snapping further (or not at all) are flagged or excluded
+    bool snap_exclude = false;     // Drop flagged locations instead of filling their cells with fallbacks
+    std::vector<char> snap_flagged; // Per location, set by the pre-flight when flagged
+
+    // Sharded runs (see Sharding.h): a coordinator splits the rows over worker processes and merges their outputs
+    int shards = 0;                           // If > 0, coordinate a run split into this many row shards
+    int shard_workers = 0;                    // Local worker processes the coordinator starts (0: only external workers)
+    std::string shard_dir = "/app/results/shards"; // Shared directory of the sharded run
+    std::string shard_worker_dir = "";        // If set, run as a worker of the sharded run in this directory
+    std::vector<std::string> shard_job_args;  // Command line options passed on to the workers
+    std::string executable = "";              // This program, started for local workers
+
+    // Output formats: CSV text, raw binary matrix files and/or row-delta + zstd compressed matrix files, route status,
+    // Arrow IPC stream and/or Parquet tables (see TableFile.h)
+    bool output_csv = true;
+    bool output_binary = false;
+    bool output_compressed = false;
+    bool output_status = false; // Route status matrix (route_status.csv)
+    bool output_arrow = false;
+    bool output_parquet = false;
+    TableLayout table_layout = TableLayout::Long; // Layout of the Arrow and Parquet tables
+
+    // Estimates used for the cells OSRM can't route
+    fallback_policy fallback;
+
+    // Geometry export: routes of the pairs listed in this file are exported with their polyline (opt-in)
+    std::string geometry_pairs_path = "";
+    bool geometry_annotations = false; // Also export the per-segment durations and distances of each leg
 
     // Parsed coordinates (latitude, longitude) read from the file at `pathTO_coordinates`.
     std::vector<std::pair<double, double>> coordinates;
 
+    MultiPolygon service_area; // If not empty, loaded coordinates outside this area are dropped before routing
+
     bool sampledCoordinates = false; // whether the coordinates were sampled (true) or loaded from file (false)
+    uint64_t seed = 0;               // seed for random sampling (drawn from std::random_device unless --seed is given)
 
     // Constructor
     osrm_params() {};
 
     // Destructor
     ~osrm_params() {
-        // Free TravelTimes
-        if (TravelTimes != nullptr) {
-            for (int i = 0; i < Number_of_locations; ++i) {
-                if (TravelTimes[i] != nullptr) {
-                    delete[] TravelTimes[i];
-                    TravelTimes[i] = nullptr;
-                }
-            }
-            delete[] TravelTimes;
-            TravelTimes = nullptr;
-        }
+        // Free matrices and engines of every dataset before static destructors run
+        datasets.clear();
 
-        // Free TravelDistances
-        if (TravelDistances != nullptr) {
-            for (int i = 0; i < Number_of_locations; ++i) {
-                if (TravelDistances[i] != nullptr) {
-                    delete[] TravelDistances[i];
-                    TravelDistances[i] = nullptr;
-                }
+        std::cout << "OSRM resources cleaned up." << std::endl;
+    }
+
+    // Add a dataset to route on. `name` labels its outputs, `path` points to its .osrm base file.
+    // Returns false if a dataset with the same name already exists.
+    inline bool add_dataset(const std::string &name, const std::string &path) {
+        for (const auto &dataset : datasets) {
+            if (dataset->name == name) {
+                std::cerr << "Duplicate dataset name: " << name << std::endl;
+                return false;
             }
-            delete[] TravelDistances;
-            TravelDistances = nullptr;
+        }
+        datasets.push_back(std::make_unique<osrm_dataset>(name, path, algorithm));
+        return true;
+    }
+ 
+    // Replace the (single, MLD) dataset by one customised dataset per time slice. The slice datasets are
+    // written next to the base dataset in '<base>.slices/<slice name>/'. Exits if a slice can't be prepared.
+    inline void prepare_time_slices() {
+        if (datasets.size() != 1 || datasets[0]->algorithm != osrm::EngineConfig::Algorithm::MLD) {
+            std::cerr << "Time slices need exactly one dataset prepared for MLD (--algorithm mld).\n";
+            exit(EXIT_FAILURE);
         }
 
-        // Reset engine unique_ptr to release OSRM internal resources before static destructors run
-        if (engine) {
-            engine.reset();
+        const std::string basePath = datasets[0]->pathTo_OSM_data;
+        const std::string sliceDir = basePath + ".slices";
+        datasets.clear();
+        for (const auto &slice : time_slices) {
+            std::string slicePath;
+            if (!prepare_time_slice(basePath, slice, sliceDir, customize_binary, slicePath)) {
+                std::cerr << "Failed to prepare time slice: " << slice.name << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            datasets.push_back(std::make_unique<osrm_dataset>(slice.name, slicePath, osrm::EngineConfig::Algorithm::MLD));
         }
+    }
 
-        std::cout << "OSRM resources cleaned up." << std::endl;
+    // Output path of `file` for `dataset`: results/<file> for a single dataset, results/<name>/<file> when
+    // several datasets are routed in one run.
+    inline std::string output_path(const osrm_dataset &dataset, const std::string &file) const {
+        if (datasets.size() <= 1) return output_dir + "/" + file;
+        return output_dir + "/" + dataset.name + "/" + file;
     }
- 
-    // Load coordinates from a text file. Each line should contain two whitespace-separated numbers
-    // (latitude and longitude). If `path` is empty, `pathTO_coordinates` member is used.
-    // Returns true on success, false otherwise. On success `coordinates` is populated and
-    // `Number_of_locations` is updated.
+
+    // Load coordinates from a file. Text files contain one "<longitude> <latitude>" pair per line,
+    // binary files (.f64/.bin or .f32) contain raw (longitude, latitude) values, see CoordinateLoader.h.
+    // If `path` is empty, `pathTO_coordinates` member is used.
+    // Returns true on success, false otherwise. On success `coordinates` is populated.
     inline bool load_coordinates_from_file(const std::string &path = "") {
         const std::string file = path.empty() ? pathTO_coordinates : path;
         if (file.empty()) {
@@ -87,109 +279,94 @@ struct osrm_params {
             return false;
         }
 
-        std::ifstream in(file);
-        if (!in.is_open()) {
-            std::cerr << "Failed to open coordinates file: " << file << std::endl;
-            return false;
-        }
-
-        coordinates.clear();
-        std::string line;
-        while (std::getline(in, line)) {
-            // Skip empty lines
-            if (line.find_first_not_of(" \t\r\n") == std::string::npos) continue;
+        return load_coordinates(file, coordinates, coordinates_format, std::max(1, write_threads));
+    }
 
-            std::istringstream ss(line);
-            double a, b;
-            if (!(ss >> a >> b)) {
-                std::cerr << "Skipping malformed coordinate line: '" << line << "'" << std::endl;
-                continue;
-            }
-            coordinates.emplace_back(a, b);
+    // Sample `count` random points inside `area` and populate OSRM.coordinates.
+    // Sampling runs in parallel but is reproducible: the same `seed` always yields the same points.
+    // Note: OSRM.coordinates stores pairs as (longitude, latitude) to match the rest of the code.
+    inline void sample_locations_in_area(const MultiPolygon &area, int count, const std::string &areaName) {
+        if (count <= 0) {
+            std::cerr << "sample_locations_in_area: count must be > 0" << std::endl;
+            return;
         }
 
-        return true;
-    }
+        const int num_threads = std::max(1, max_threads);
+        const uint64_t attempts = sample_points_in_area(area, count, seed, num_threads, coordinates);
 
+        if ((int)coordinates.size() < count) {
+            std::cerr << "Warning: only sampled " << coordinates.size() << " points after " << attempts << " attempts. Is the polygon very small compared to its bounding box?" << std::endl;
+        }
 
-    // Simple ray-casting point-in-polygon test (returns true if point is inside polygon).
-    inline bool point_in_polygon(double lon, double lat, const std::vector<std::pair<double,double>> &poly) {
-        bool inside = false;
-        int n = static_cast<int>(poly.size());
-        for (int i = 0, j = n - 1; i < n; j = i++) {
-            double xi = poly[i].first, yi = poly[i].second;
-            double xj = poly[j].first, yj = poly[j].second;
+        Number_of_locations = static_cast<int>(coordinates.size());
+        std::cout << "Sampled " << Number_of_locations << " coordinates inside " << areaName << " (seed " << seed << ")." << std::endl;
 
-            bool intersect = ((yi > lat) != (yj > lat)) &&
-                            (lon < (xj - xi) * (lat - yi) / (yj - yi + 0.0) + xi);
-            if (intersect) inside = !inside;
-        }
-        return inside;
+        sampledCoordinates = true;
     }
+
     // Sample `count` random points inside Belgium and populate OSRM.coordinates.
     // This uses a simplified Belgium polygon and a bounding box for generation.
-    // Note: OSRM.coordinates stores pairs as (longitude, latitude) to match the rest of the code.
     inline void sample_locations_in_belgium(int count) {
-        if (count <= 0) {
-            std::cerr << "sample_locations_in_belgium: count must be > 0" << std::endl;
-            return;
-        }
-
         // Smaller central-Belgium polygon (lon, lat) to keep sampled points within a reliable area.
         // This covers the central region (around Brussels / Antwerp corridor) and is intentionally
         // smaller than the full-country polygon to reduce out-of-bounds samples.
-        const std::vector<std::pair<double,double>> belgium_poly = {
+        MultiPolygon belgium;
+        belgium.polygons.push_back({{
             {3.8, 50.8}, {4.6, 50.8}, {5.1, 50.95}, {4.9, 51.25}, {4.2, 51.25}, {3.7, 51.05}
-        };
-
-        // Tight bounding box around the smaller polygon (lon, lat)
-        const double lon_min = 3.7, lon_max = 5.1;
-        const double lat_min = 50.7, lat_max = 51.3;
-
-        std::random_device rd;
-        unsigned int seed = rd();
-    
-        std::mt19937 rng(seed);
-        std::uniform_real_distribution<double> lon_dist(lon_min, lon_max);
-        std::uniform_real_distribution<double> lat_dist(lat_min, lat_max);
-
-        coordinates.clear();
-        Number_of_locations = 0;
-
-        const int max_attempts = std::max(10000, count * 1000);
-        int attempts = 0;
-
-        while ((int)coordinates.size() < count && attempts < max_attempts) {
-            ++attempts;
-            double lon = lon_dist(rng);
-            double lat = lat_dist(rng);
-
-            if (!point_in_polygon(lon, lat, belgium_poly)) continue; // reject points outside polygon
-            
-            // Avoid near-duplicates using a small epsilon
-            bool dup = false;
-            for (const auto &p : coordinates) {
-                if (std::abs(p.first - lon) < 1e-6 && std::abs(p.second - lat) < 1e-6) {
-                    dup = true;
-                    break;
-                }
-            }
-            if (dup) continue;
-            
+        }});
+        belgium.update_bounds();
 
-            // Store as (longitude, latitude)
-            coordinates.emplace_back(lon, lat);
+        sample_locations_in_area(belgium, count, "Belgium");
+    }
 
+    // Drop all coordinates outside `area`. The containment tests run in parallel on the band index of the
+    // polygon. Dropped points are written as "<input index> <longitude> <latitude>" to `excludedFile`.
+    // Returns the number of dropped coordinates.
+    inline int filter_coordinates_to_area(const MultiPolygon &area, const std::string &excludedFile) {
+        const int n = static_cast<int>(coordinates.size());
+        std::unique_ptr<char[]> inside = std::make_unique<char[]>(n);
+
+        int num_threads = std::max(1, max_threads);
+        int payload_size = (n + num_threads - 1) / num_threads;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; ++t) {
+            int start_i = t * payload_size;
+            int end_i = std::min(n, (t + 1) * payload_size);
+            threads.emplace_back([start_i, end_i, &inside, &area, this]() {
+                for (int i = start_i; i < end_i; ++i) {
+                    inside[i] = area.contains(coordinates[i].first, coordinates[i].second);
+                }
+            });
         }
-
-        if ((int)coordinates.size() < count) {
-            std::cerr << "Warning: only sampled " << coordinates.size() << " points after " << attempts << " attempts. Try increasing max_attempts or use replacement." << std::endl;
+        for (auto &t : threads) {
+            t.join();
         }
 
-        Number_of_locations = static_cast<int>(coordinates.size());
-        std::cout << "Sampled " << Number_of_locations << " coordinates inside Belgium." << std::endl;
+        std::ofstream out;
+        std::vector<std::pair<double, double>> kept;
+        kept.reserve(n);
+        for (int i = 0; i < n; ++i) {
+            if (inside[i]) {
+                kept.push_back(coordinates[i]);
+                continue;
+            }
+            if (!out.is_open()) {
+                std::filesystem::path p(excludedFile);
+                if (!p.parent_path().empty()) std::filesystem::create_directories(p.parent_path());
+                out.open(excludedFile);
+                out << std::setprecision(10);
+            }
+            out << i << ' ' << coordinates[i].first << ' ' << coordinates[i].second << '\n';
+        }
 
-        sampledCoordinates = true;
+        const int dropped = n - static_cast<int>(kept.size());
+        coordinates.swap(kept);
+        // Sampled runs set Number_of_locations before the filter, it must not exceed the kept locations
+        Number_of_locations = std::min(Number_of_locations, static_cast<int>(coordinates.size()));
+        std::cout << "Service area filter kept " << coordinates.size() << " of " << n << " coordinates";
+        if (dropped > 0) std::cout << ", dropped locations written to: " << excludedFile;
+        std::cout << std::endl;
+        return dropped;
     }
 
         // Save current coordinates to a whitespace-separated text file. Each line: <longitude> <latitude>
@@ -221,11 +398,30 @@ struct osrm_params {
             return true;
         }
 
-    // start osrm engine
-    void start_engine() {
+    // start osrm engines
+    // Size the thread pools. `routing` threads route (compute bound), `writing` threads load and write files
+    // (I/O bound); 0 means one per CPU this process can use, respecting the affinity mask and cgroup CPU quota.
+    inline void configure_threads(int routing = 0, int writing = 0) {
+        const int cpus = available_cpus();
+        max_threads = routing > 0 ? routing : cpus;
+        write_threads = writing > 0 ? writing : cpus;
+        if (max_threads > cpus) {
+            std::cerr << "Warning: " << max_threads << " routing threads on " << cpus << " available CPUs";
+            const double quota = cgroup_cpu_limit();
+            if (quota > 0) std::cerr << " (cgroup quota " << quota << " CPUs)";
+            std::cerr << ", expect oversubscription." << std::endl;
+        }
+    }
+
+    // Load the coordinates (unless they were sampled), apply the service area and set Number_of_locations.
+    // Returns false if no locations are left.
+    bool prepare_locations() {
         // Load coordinates from file
         if(!sampledCoordinates) load_coordinates_from_file(pathTO_coordinates);
 
+        // Restrict the locations to the service area, if one was given
+        if (!service_area.empty()) filter_coordinates_to_area(service_area, output_dir + "/outside_service_area.txt");
+
         // If Number_of_locations wasn't set explicitly, use the number of loaded coordinates.
         if (Number_of_locations == 0) {
             Number_of_locations = static_cast<int>(coordinates.size());
@@ -233,30 +429,112 @@ struct osrm_params {
 
         if (Number_of_locations <= 0) {
             std::cerr << "No locations available to start engine. Ensure coordinates are loaded.\n";
-            exit(EXIT_FAILURE);
+            return false;
+        }
+
+        // Destinations of the reductions, the format follows the file extension
+        if (!pathTO_destinations.empty()) {
+            if (!load_coordinates(pathTO_destinations, destinations, CoordinateFormat::Auto, std::max(1, write_threads))) return false;
+            if (destinations.empty()) {
+                std::cerr << "No destinations in " << pathTO_destinations << std::endl;
+                return false;
+            }
+            std::cout << "Loaded " << destinations.size() << " destinations from " << pathTO_destinations << std::endl;
+        }
+        return true;
+    }
+
+    // Whether the options allow a sharded run (the coordinator only merges CSV and .mtx files)
+    bool shardable() const {
+        return !(output_compressed || output_arrow || output_parquet || symmetric || approximate_clusters > 0 || circuity_samples > 0 || !geometry_pairs_path.empty() ||
+                 !time_slices.empty() || snap_exclude);
+    }
+
+    // What shardable() allows, for the error messages
+    static std::string shardable_options() {
+        return "the csv, bin and status outputs only, without --symmetric, --approximate, --circuity, --geometry-pairs, --time-slice or --snap-exclude";
+    }
+
+    // Reduction mode: per-row results (nearest destinations, statistics, histograms) instead of matrices
+    bool reduction() const { return reduce_nearest > 0 || reduce_stats || reduce_histogram_bins > 0; }
+
+    // Sparse mode: keep only the pairs within max_duration and/or max_distance instead of full matrices
+    bool sparse() const { return max_duration > 0 || max_distance > 0; }
+
+    // Allocate the result matrices of every dataset for `rows` origins (a row shard) to all locations
+    void allocate_matrices(int rows) {
+        for (auto &dataset : datasets) {
+            if (!dataset->allocate_matrices(rows, Number_of_locations, time_encoding, distance_encoding, symmetric && rows == Number_of_locations)) {
+                std::cerr << "Unsupported matrix encoding, use 16, 24 or 32 bits and a positive unit.\n";
+                exit(EXIT_FAILURE);
+            }
         }
+    }
+
+    void start_engine() {
+        // Thread pools default to the available CPUs
+        if (max_threads <= 0) configure_threads();
 
-        TravelTimes = new int *[Number_of_locations];
-        TravelDistances = new int *[Number_of_locations];
-        for (int i = 0; i < Number_of_locations; i++) {
-            TravelTimes[i] = new int[Number_of_locations];
-            TravelDistances[i] = new int[Number_of_locations];
+        if (datasets.empty()) {
+            std::cerr << "No OSRM dataset given to start the engine.\n";
+            exit(EXIT_FAILURE);
         }
 
-        // Set the number of threads to the maximum available
-        max_threads = static_cast<int>(std::thread::hardware_concurrency());
+        // Customise one metric per time slice, cheap compared to a full extract + contract
+        if (!time_slices.empty()) prepare_time_slices();
 
-        // Configure based on a .osrm base path, and no datasets in shared mem from osrm-datastore
-        config.storage_config = {pathTo_OSM_data};
-        config.use_shared_memory = false;
+        if (numa) {
+            numa_nodes = detect_numa_nodes();
+            std::cout << " - NUMA nodes:";
+            for (const auto &node : numa_nodes) std::cout << " " << node.id << " (" << node.cpus.size() << " cpus)";
+            std::cout << (numa_replicas && numa_nodes.size() > 1 ? ", one engine replica per node" : "") << std::endl;
+        }
 
-        // We support two routing speed up techniques:
-        // - Contraction Hierarchies (CH): requires extract+contract pre-processing
-        // - Multi-Level Dijkstra (MLD): requires extract+partition+customize pre-processing
-        config.algorithm = osrm::EngineConfig::Algorithm::CH; // or MLD
-        // config.algorithm = osrm::EngineConfig::Algorithm::MLD;
+        // Load all datasets concurrently, loading is mostly I/O bound. Meanwhile this thread parses the
+        // coordinates: neither needs the other.
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        std::vector<char> loaded(datasets.size(), 0);
+        std::vector<double> load_seconds(datasets.size(), 0.0);
+        for (size_t d = 0; d < datasets.size(); ++d) {
+            threads.emplace_back([this, d, start, &loaded, &load_seconds]() {
+                // With NUMA placement the main engine lives on the first node
+                if (numa) pin_current_thread(numa_nodes[0].cpus);
+                loaded[d] = datasets[d]->start_engine(fallback);
+                load_seconds[d] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            });
+        }
+        // Manifest jobs bring their own locations
+        const bool located = manifest_path.empty() ? prepare_locations() : true;
+        const double locations_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        for (auto &t : threads) {
+            t.join();
+        }
+        if (!located) exit(EXIT_FAILURE);
+        const double wait_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() - locations_seconds;
+        std::cout << std::fixed << std::setprecision(1) << " - Pipeline: locations ready after " << locations_seconds << " s, datasets loaded after "
+                  << *std::max_element(load_seconds.begin(), load_seconds.end()) << " s (waited " << wait_seconds << " s for the datasets)"
+                  << std::defaultfloat << std::endl;
+        if (std::find(loaded.begin(), loaded.end(), 0) != loaded.end()) {
+            std::cerr << "Failed to load every OSRM dataset.\n";
+            exit(EXIT_FAILURE);
+        }
 
-        engine = std::make_unique<osrm::OSRM>(config);
+        if (numa && numa_replicas) {
+            threads.clear();
+            for (auto &dataset : datasets) {
+                for (int node = 1; node < static_cast<int>(numa_nodes.size()); ++node) {
+                    threads.emplace_back([this, &dataset, node]() {
+                        pin_current_thread(numa_nodes[node].cpus);
+                        // Workers of a node without replica share the main engine
+                        if (!dataset->start_replica(node)) std::cerr << "Warning: no " << dataset->name << " replica on NUMA node " << node << std::endl;
+                    });
+                }
+            }
+            for (auto &t : threads) {
+                t.join();
+            }
+        }
     }
 };
 
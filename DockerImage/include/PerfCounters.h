@@ -0,0 +1,41 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+// std libs
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Hardware performance counters of the routing and writing threads (--perf-counters), to tell why throughput
+// drops on large extracts: cache misses in the graph, TLB misses or a low IPC. Every thread opens its own
+// counters with perf_event_open (Linux, user space only, so perf_event_paranoid up to 2 is enough) around its
+// loop and adds them to the totals of its stage when it is done. Counters the kernel or container doesn't
+// provide are left out; elsewhere nothing is counted.
+enum perf_counter { PERF_INSTRUCTIONS, PERF_CYCLES, PERF_CACHE_MISSES, PERF_DTLB_MISSES, PERF_COUNTER_COUNT };
+
+// Counter values of a stage, summed over its threads
+struct perf_totals {
+    std::atomic<int64_t> value[PERF_COUNTER_COUNT] = {};
+    std::atomic<int> threads[PERF_COUNTER_COUNT] = {}; // Threads that counted this counter
+    std::atomic<int64_t> cells{0};                     // Matrix cells computed or written by the stage
+    std::atomic<int> error{0};                         // errno of the first counter that failed to open
+
+    // Print one line " - Counters <stage>: ... per cell", or why nothing was counted
+    void report(const std::string &stage) const;
+};
+
+// Counters of the calling thread from construction to destruction, then added to `totals`.
+// Does nothing if `totals` is null.
+class thread_counters {
+public:
+    explicit thread_counters(perf_totals *totals);
+    ~thread_counters();
+    thread_counters(const thread_counters &) = delete;
+    thread_counters &operator=(const thread_counters &) = delete;
+
+private:
+    perf_totals *totals_;
+    int fd_[PERF_COUNTER_COUNT];
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+// std libs
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// A matrix run is a pipeline of stages: the datasets load while the coordinates are parsed, then the routing
+// workers fill the matrices block by block while the writers stream every finished row to the output files.
+
+// Called by a writer before it reads row `row`: blocks until that row (and every row before it) is complete.
+// An empty function means all rows are complete.
+using row_wait_fn = std::function<void(int row)>;
+
+// Thread time of a stage and the part of it spent waiting on another stage, summed over its threads
+struct stage_clock {
+    std::atomic<int64_t> total_us{0};
+    std::atomic<int64_t> idle_us{0};
+
+    void add_time(std::chrono::steady_clock::duration d) { total_us += std::chrono::duration_cast<std::chrono::microseconds>(d).count(); }
+    void add_idle(std::chrono::steady_clock::duration d) { idle_us += std::chrono::duration_cast<std::chrono::microseconds>(d).count(); }
+
+    double busy_seconds() const { return (total_us - idle_us) / 1e6; }
+    double idle_seconds() const { return idle_us / 1e6; }
+
+    // Share of the stage's thread time spent working, 0 .. 1
+    double busy_share() const { return total_us > 0 ? static_cast<double>(total_us - idle_us) / total_us : 0.0; }
+};
+
+// Completion of the rows of the matrices being routed. Routing workers finish row blocks in any order;
+// writers wait for the complete prefix, so they can stream rows in order while later blocks are still routed.
+// Waiting is counted as idle time of `clock`.
+class row_progress {
+public:
+    explicit row_progress(int rows, stage_clock *clock = nullptr) : done_(rows, 0), clock_(clock) {}
+
+    // Rows [first, last) are complete
+    void complete(int first, int last) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::fill(done_.begin() + first, done_.begin() + last, 1);
+        int prefix = prefix_.load(std::memory_order_relaxed);
+        while (prefix < static_cast<int>(done_.size()) && done_[prefix]) ++prefix;
+        prefix_.store(prefix, std::memory_order_release);
+        ready_.notify_all();
+    }
+
+    // Block until row `row` and every row before it are complete
+    void wait(int row) {
+        if (row < prefix_.load(std::memory_order_acquire)) return;
+        const auto start = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [&] { return row < prefix_.load(std::memory_order_relaxed); });
+        if (clock_) clock_->add_idle(std::chrono::steady_clock::now() - start);
+    }
+
+    row_wait_fn waiter() {
+        return [this](int row) { wait(row); };
+    }
+
+private:
+    std::vector<char> done_;
+    std::atomic<int> prefix_{0};
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    stage_clock *clock_;
+};
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+// std libs
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Polygon.h"
+
+// Sample up to `count` distinct random (longitude, latitude) points inside `area` into `points`.
+// Candidates are drawn uniformly in the bounding box in fixed-size blocks; every block has its own
+// RNG seeded from (`seed`, block index) and blocks are consumed in index order, so the result only
+// depends on `seed`, never on `num_threads`. Near-duplicates (closer than 1e-6 degrees in both
+// coordinates) are rejected through a spatial hash. At most max(10000, count * 1000) candidates are drawn.
+// Returns the number of candidates drawn.
+uint64_t sample_points_in_area(const MultiPolygon &area, int count, uint64_t seed, int num_threads,
+                               std::vector<std::pair<double, double>> &points);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef SHARDING_H
+#define SHARDING_H
+
+// std libs
+#include <string>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+// Sharded matrix runs exchange work through a shared directory (a local disk for worker processes on
+// the same box, or a network filesystem for workers on several hosts):
+//   job.args          : the worker's command line options, one per line
+//   coordinates.f64   : the locations of the run (raw lon/lat doubles), so every worker routes the same points
+//   flagged.u8        : one byte per location, 1 if the coordinator's snap pre-flight flagged it (optional)
+//   shard_NNNN.todo   : one row shard "first_row rows", waiting for a worker
+//   shard_NNNN.claimed.<host>.<pid> : the shard, claimed by a worker (atomic rename of the .todo file)
+//   shard_NNNN/       : the output files of the shard (same names as a normal run)
+//   shard_NNNN.done   : the shard is complete (rename of the claim after its outputs are written)
+//   shard_NNNN.failed : the shard can't be computed (invalid spec, outputs not marked), with the reason
+// A shard whose worker died stays claimed; renaming it back to .todo makes it available again.
+
+// Row range of one shard
+struct shard_spec {
+    int index = 0;
+    int first_row = 0;
+    int rows = 0;
+};
+
+// Create `dir` for a sharded run of `coordinates` split into `shards` row shards: writes the job
+// arguments, the coordinates, the snap flags (if not empty) and the shard specs, after removing leftovers
+// of a previous run.
+bool write_shard_job(const std::string &dir, const std::vector<std::string> &args,
+                     const std::vector<std::pair<double, double>> &coordinates, const std::vector<char> &flagged, int shards);
+
+// Read the worker arguments of the job in `dir`
+bool read_shard_job_args(const std::string &dir, std::vector<std::string> &args);
+
+// Read the snap flags of the `n` locations of the job in `dir`, empty if the job has none
+bool read_shard_flags(const std::string &dir, int n, std::vector<char> &flagged);
+
+// Claim the next open shard of `dir`. Returns false if no shard is left. A shard with a malformed spec is
+// marked failed and skipped.
+bool claim_shard(const std::string &dir, shard_spec &spec, std::string &claimPath);
+
+// Mark a claimed shard as done, once its outputs are written
+bool finish_shard(const std::string &dir, const shard_spec &spec, const std::string &claimPath);
+
+// Mark a claimed shard as failed with `reason`, releasing the claim
+bool fail_shard(const std::string &dir, int index, const std::string &claimPath, const std::string &reason);
+
+// Failed shards of `dir`: index and reason
+std::vector<std::pair<int, std::string>> failed_shards(const std::string &dir, int shards);
+
+// Output directory of shard `index`
+std::string shard_output_dir(const std::string &dir, int index);
+
+// Number of completed shards in `dir`
+int count_done_shards(const std::string &dir, int shards);
+
+// Start a worker process `executable args...`, its pid is stored in `pid`
+bool spawn_process(const std::string &executable, const std::vector<std::string> &args, pid_t &pid);
+
+// Merge the outputs of all shards into `outputDir`: CSV files are concatenated and the rows of raw .mtx
+// matrix files are appended behind one header. Files are streamed, the merge needs no matrix in memory.
+bool merge_shard_outputs(const std::string &dir, int shards, const std::string &outputDir);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+// CPU quota of the cgroup this process runs in (e.g. a container limited to 2.5 CPUs), 0 if unlimited or unknown.
+// Reads cgroup v2 'cpu.max' or cgroup v1 'cpu.cfs_quota_us' / 'cpu.cfs_period_us'.
+double cgroup_cpu_limit();
+
+// Number of CPUs this process can actually use: the CPUs of its affinity mask, capped by the cgroup quota
+// (rounded up), falling back to std::thread::hardware_concurrency(). Always >= 1.
+int available_cpus();
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef TIME_SLICES_H
+#define TIME_SLICES_H
+
+// std libs
+#include <string>
+#include <vector>
+
+// One time slice (e.g. 'peak', 'offpeak') of an MLD dataset: the traffic files osrm-customize applies to it
+struct time_slice {
+    std::string name = "";                // Label of the slice, used as dataset name and output folder
+    std::vector<std::string> speed_files; // Segment speed CSVs (--segment-speed-file)
+    std::vector<std::string> turn_files;  // Turn penalty CSVs (--turn-penalty-file)
+};
+
+// Parse a '--time-slice' argument of the form 'name=speeds.csv[,speeds2.csv][:turns.csv[,turns2.csv]]'.
+// Returns false if the argument is malformed.
+bool parse_time_slice(const std::string &arg, time_slice &slice);
+
+// Prepare a customised copy of the MLD dataset `basePath` (a '.osrm' base path) for `slice` in `sliceDir`.
+// The files osrm-customize rewrites are copied, all other dataset files are symlinked, so the base
+// dataset stays untouched and a slice only costs the size of its metric. Then `customizeBinary` is run
+// with the slice's speed and turn penalty files. On success `slicePath` is the '.osrm' base path of the slice.
+bool prepare_time_slice(const std::string &basePath, const time_slice &slice, const std::string &sliceDir,
+                        const std::string &customizeBinary, std::string &slicePath);
+
+#endif
@@ -0,0 +1,240 @@
+// std libs
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// POSIX memory mapping
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CoordinateLoader.h"
+
+// ********************************* LOCAL PARAMETERS ************************************
+// Files smaller than this are parsed on the calling thread, spawning workers is not worth it
+#define PARALLEL_PARSE_MIN_BYTES (1 << 20)
+// Maximum number of malformed lines that are printed, the rest is only counted
+#define MAX_REPORTED_MALFORMED_LINES 10
+
+// ++++++++++++++++++++++++++++++++++++++ FUNCTIONS ++++++++++++++++++++++++++++++++++++++
+
+namespace {
+
+// Read-only memory mapping of a whole file, unmapped when it goes out of scope
+struct MappedFile {
+    const char *data = nullptr;
+    size_t size = 0;
+    int fd = -1;
+
+    bool open(const std::string &file) {
+        fd = ::open(file.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) return false;
+        size = static_cast<size_t>(st.st_size);
+        if (size == 0) return true; // mmap refuses zero-length mappings, an empty file is simply empty
+
+        void *ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr == MAP_FAILED) return false;
+        madvise(ptr, size, MADV_SEQUENTIAL);
+        data = static_cast<const char *>(ptr);
+        return true;
+    }
+
+    ~MappedFile() {
+        if (data != nullptr) munmap(const_cast<char *>(data), size);
+        if (fd >= 0) ::close(fd);
+    }
+};
+
+inline bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Parse one double starting at `first`, returns the position after it or nullptr on failure.
+// A leading '+' is accepted to stay compatible with the old istream based parser.
+inline const char *parse_double(const char *first, const char *last, double &value) {
+    if (first < last && *first == '+') ++first;
+#if defined(__cpp_lib_to_chars)
+    auto res = std::from_chars(first, last, value);
+    if (res.ec != std::errc()) return nullptr;
+    return res.ptr;
+#else
+    // Standard libraries without floating point from_chars: copy the token and use strtod
+    char buffer[64];
+    size_t len = 0;
+    while (first + len < last && len + 1 < sizeof(buffer) && !is_blank(first[len]) && first[len] != '\n') {
+        buffer[len] = first[len];
+        ++len;
+    }
+    buffer[len] = '\0';
+    char *end = nullptr;
+    value = std::strtod(buffer, &end);
+    if (end == buffer) return nullptr;
+    return first + (end - buffer);
+#endif
+}
+
+// Result of parsing one newline-aligned chunk of a text file
+struct ParsedChunk {
+    std::vector<std::pair<double, double>> coordinates;
+    std::vector<std::pair<size_t, std::string>> malformed; // (line number within the chunk, line content)
+    size_t malformed_count = 0;
+    size_t lines = 0;
+};
+
+// Parse all lines in [first, last), `last` is either the end of the file or just past a '\n'
+void parse_chunk(const char *first, const char *last, ParsedChunk &chunk) {
+    const char *line = first;
+    while (line < last) {
+        const char *eol = static_cast<const char *>(std::memchr(line, '\n', last - line));
+        if (eol == nullptr) eol = last;
+        ++chunk.lines;
+
+        const char *p = line;
+        while (p < eol && is_blank(*p)) ++p;
+        if (p < eol) { // skip empty lines
+            double a, b;
+            const char *q = parse_double(p, eol, a);
+            bool ok = q != nullptr && q < eol && is_blank(*q);
+            if (ok) {
+                while (q < eol && is_blank(*q)) ++q;
+                q = parse_double(q, eol, b);
+                ok = q != nullptr && (q == eol || is_blank(*q));
+            }
+
+            if (ok) {
+                chunk.coordinates.emplace_back(a, b);
+            }
+            else {
+                if (chunk.malformed.size() < MAX_REPORTED_MALFORMED_LINES) {
+                    const char *end = eol;
+                    if (end > line && end[-1] == '\r') --end;
+                    chunk.malformed.emplace_back(chunk.lines, std::string(line, end));
+                }
+                ++chunk.malformed_count;
+            }
+        }
+        line = eol + 1;
+    }
+}
+
+bool load_text(const MappedFile &mapped, std::vector<std::pair<double, double>> &coordinates, int num_threads) {
+    const char *data = mapped.data;
+    const size_t size = mapped.size;
+
+    if (size < PARALLEL_PARSE_MIN_BYTES) num_threads = 1;
+    num_threads = std::max(1, num_threads);
+
+    // Split into roughly equal chunks and move every boundary just past the next newline
+    std::vector<size_t> bounds = {0};
+    for (int i = 1; i < num_threads; ++i) {
+        size_t b = std::max(bounds.back(), size * i / num_threads);
+        const void *nl = b < size ? std::memchr(data + b, '\n', size - b) : nullptr;
+        b = nl == nullptr ? size : static_cast<size_t>(static_cast<const char *>(nl) - data) + 1;
+        if (b > bounds.back() && b < size) bounds.push_back(b);
+    }
+    bounds.push_back(size);
+
+    const int num_chunks = static_cast<int>(bounds.size()) - 1;
+    std::vector<ParsedChunk> chunks(num_chunks);
+    std::vector<std::thread> threads;
+    for (int c = 1; c < num_chunks; ++c) {
+        threads.emplace_back([&, c]() { parse_chunk(data + bounds[c], data + bounds[c + 1], chunks[c]); });
+    }
+    if (num_chunks > 0) parse_chunk(data + bounds[0], data + bounds[1], chunks[0]);
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    // Concatenate in file order and turn chunk-local line numbers into file line numbers
+    size_t total = 0;
+    for (const auto &chunk : chunks) total += chunk.coordinates.size();
+    coordinates.clear();
+    coordinates.reserve(total);
+
+    size_t line_offset = 0;
+    size_t malformed_count = 0;
+    for (const auto &chunk : chunks) {
+        coordinates.insert(coordinates.end(), chunk.coordinates.begin(), chunk.coordinates.end());
+        for (const auto &bad : chunk.malformed) {
+            if (malformed_count++ < MAX_REPORTED_MALFORMED_LINES) {
+                std::cerr << "Skipping malformed coordinate line " << line_offset + bad.first << ": '" << bad.second << "'" << std::endl;
+            }
+        }
+        malformed_count += chunk.malformed_count - chunk.malformed.size();
+        line_offset += chunk.lines;
+    }
+    if (malformed_count > MAX_REPORTED_MALFORMED_LINES) {
+        std::cerr << "Skipped " << malformed_count << " malformed coordinate lines in total." << std::endl;
+    }
+
+    return true;
+}
+
+template <typename T>
+bool load_binary(const MappedFile &mapped, const std::string &file, std::vector<std::pair<double, double>> &coordinates) {
+    const size_t record = 2 * sizeof(T);
+    if (mapped.size % record != 0) {
+        std::cerr << "Binary coordinates file " << file << " has size " << mapped.size << ", which is not a multiple of " << record << " bytes" << std::endl;
+        return false;
+    }
+
+    // The mapping carries no alignment guarantee, so values are read with memcpy
+    const size_t n = mapped.size / record;
+    coordinates.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        T lon, lat;
+        std::memcpy(&lon, mapped.data + i * record, sizeof(T));
+        std::memcpy(&lat, mapped.data + i * record + sizeof(T), sizeof(T));
+        coordinates[i] = {lon, lat};
+    }
+    return true;
+}
+
+CoordinateFormat format_from_extension(const std::string &file) {
+    auto ends_with = [&file](const std::string &ext) {
+        return file.size() >= ext.size() && file.compare(file.size() - ext.size(), ext.size(), ext) == 0;
+    };
+    if (ends_with(".f64") || ends_with(".bin")) return CoordinateFormat::Float64;
+    if (ends_with(".f32")) return CoordinateFormat::Float32;
+    return CoordinateFormat::Text;
+}
+
+} // namespace
+
+bool parse_coordinate_format(const std::string &name, CoordinateFormat &format) {
+    if (name == "auto") format = CoordinateFormat::Auto;
+    else if (name == "text" || name == "txt") format = CoordinateFormat::Text;
+    else if (name == "f64" || name == "float64") format = CoordinateFormat::Float64;
+    else if (name == "f32" || name == "float32") format = CoordinateFormat::Float32;
+    else return false;
+    return true;
+}
+
+bool load_coordinates(const std::string &file, std::vector<std::pair<double, double>> &coordinates, CoordinateFormat format, int num_threads) {
+    MappedFile mapped;
+    if (!mapped.open(file)) {
+        std::cerr << "Failed to open coordinates file: " << file << std::endl;
+        return false;
+    }
+
+    if (format == CoordinateFormat::Auto) format = format_from_extension(file);
+
+    switch (format) {
+    case CoordinateFormat::Float64:
+        return load_binary<double>(mapped, file, coordinates);
+    case CoordinateFormat::Float32:
+        return load_binary<float>(mapped, file, coordinates);
+    default:
+        return load_text(mapped, coordinates, num_threads);
+    }
+}
@@ -0,0 +1,135 @@
+// std libs
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "Numa.h"
+
+// ++++++++++++++++++++++++++++++++++++++ FUNCTIONS ++++++++++++++++++++++++++++++++++++++
+
+namespace {
+
+// CPUs the process is allowed to run on, empty if unknown
+std::vector<int> allowed_cpus() {
+    std::vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+        }
+    }
+#endif
+    return cpus;
+}
+
+} // namespace
+
+std::vector<int> parse_cpu_list(const std::string &list) {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        try {
+            const auto dash = range.find('-');
+            const int first = std::stoi(range.substr(0, dash));
+            const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+        }
+        catch (const std::exception &) {
+            // Skip empty or malformed ranges (e.g. the trailing newline)
+        }
+    }
+    return cpus;
+}
+
+std::vector<numa_node> detect_numa_nodes() {
+    namespace fs = std::filesystem;
+    std::vector<int> allowed = allowed_cpus();
+    std::sort(allowed.begin(), allowed.end());
+
+    std::vector<numa_node> nodes;
+    std::error_code ec;
+    for (const auto &entry : fs::directory_iterator("/sys/devices/system/node", ec)) {
+        const std::string name = entry.path().filename().string();
+        if (name.compare(0, 4, "node") != 0 || name.size() == 4 || !std::all_of(name.begin() + 4, name.end(), ::isdigit)) continue;
+
+        std::ifstream file(entry.path() / "cpulist");
+        std::string list;
+        if (!std::getline(file, list)) continue;
+
+        numa_node node;
+        node.id = std::stoi(name.substr(4));
+        for (int cpu : parse_cpu_list(list)) {
+            if (allowed.empty() || std::binary_search(allowed.begin(), allowed.end(), cpu)) node.cpus.push_back(cpu);
+        }
+        // Memory-only nodes and nodes outside our cpuset can't run workers
+        if (!node.cpus.empty()) nodes.push_back(node);
+    }
+    std::sort(nodes.begin(), nodes.end(), [](const numa_node &a, const numa_node &b) { return a.id < b.id; });
+
+    if (nodes.empty()) {
+        numa_node node;
+        node.cpus = allowed;
+        if (node.cpus.empty()) {
+            for (int cpu = 0; cpu < static_cast<int>(std::max(1u, std::thread::hardware_concurrency())); ++cpu) node.cpus.push_back(cpu);
+        }
+        nodes.push_back(node);
+    }
+    return nodes;
+}
+
+bool pin_current_thread(const std::vector<int> &cpus) {
+#ifdef __linux__
+    if (cpus.empty()) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+std::vector<int> assign_threads_to_nodes(const std::vector<numa_node> &nodes, int num_threads) {
+    std::vector<int> thread_node;
+    if (nodes.empty() || num_threads <= 0) return thread_node;
+
+    size_t total_cpus = 0;
+    for (const auto &node : nodes) total_cpus += node.cpus.size();
+
+    // Largest remainder apportionment of the workers over the nodes, at least one worker per used node
+    const int used_nodes = std::min<int>(static_cast<int>(nodes.size()), num_threads);
+    std::vector<int> share(used_nodes);
+    std::vector<std::pair<double, int>> remainders;
+    int assigned = 0;
+    for (int n = 0; n < used_nodes; ++n) {
+        const double exact = static_cast<double>(num_threads) * nodes[n].cpus.size() / std::max<size_t>(1, total_cpus);
+        share[n] = std::max(1, static_cast<int>(exact));
+        assigned += share[n];
+        remainders.emplace_back(exact - static_cast<int>(exact), n);
+    }
+    std::sort(remainders.rbegin(), remainders.rend());
+    for (size_t r = 0; assigned < num_threads; ++assigned, r = (r + 1) % remainders.size()) ++share[remainders[r].second];
+    while (assigned > num_threads) {
+        --*std::max_element(share.begin(), share.end());
+        --assigned;
+    }
+
+    for (int n = 0; n < used_nodes; ++n) thread_node.insert(thread_node.end(), share[n], n);
+    return thread_node;
+}
@@ -10,259 +10,1733 @@
 #include <cmath>
 #include <cstdint>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <filesystem>
+#include <iomanip>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <unordered_set>
+#include <sys/wait.h>
 
 // OSRM core headers used by this file
+#include "osrm/nearest_parameters.hpp"
 #include "osrm/trip_parameters.hpp"
 
 // project OSRM parameter struct and helpers
+#include "CircuityModel.h"
+#include "ClusterMatrix.h"
+#include "DiagnosticLog.h"
+#include "GeometryFile.h"
+#include "Manifest.h"
+#include "MatrixEngine.h"
+#include "MatrixFile.h"
 #include "OSRMParameters.h"
-
-// ********************************* LOCAL PARAMETERS ************************************
-// Define earth's radius for haversine distance
-#define EARTH_RADIUS 6371.0
+#include "PerfCounters.h"
+#include "Pipeline.h"
+#include "Planner.h"
+#include "Sharding.h"
+#include "SpaceFillingCurve.h"
 
 // ++++++++++++++++++++++++++++++++++++++ FUNCTIONS ++++++++++++++++++++++++++++++++++++++
 
-// Degrees transpormed into radians
-inline double degreesToRadians(const double &degrees) {
-    double res = degrees * M_PI / 180.0;
-    return res;
+// Snap pre-flight: snap every location once with the Nearest service of every dataset, in parallel, and
+// record the snap distance. Locations that can't be snapped or snap further than OSRM.max_snap_distance are
+// dropped (snap_exclude) or flagged, so their rows and columns get fallback estimates without routing.
+// Writes snap_report.csv: input index, coordinates, snap distance per dataset (-1: no segment) and status.
+inline void snap_locations(osrm_params& OSRM) {
+    const int n = OSRM.Number_of_locations;
+    const int num_datasets = static_cast<int>(OSRM.datasets.size());
+    std::vector<double> distances(static_cast<size_t>(n) * num_datasets, -1.0);
+
+    int num_threads = std::max(1, std::min(OSRM.max_threads, n));
+    int payload_size = (n + num_threads - 1) / num_threads;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        int start_i = t * payload_size;
+        int end_i = std::min(n, (t + 1) * payload_size);
+        threads.emplace_back([&, start_i, end_i]() {
+            osrm::NearestParameters params;
+            params.number_of_results = 1;
+            for (int i = start_i; i < end_i; ++i) {
+                for (int d = 0; d < num_datasets; ++d) {
+                    params.coordinates.clear();
+                    params.coordinates.push_back({osrm::util::FloatLongitude{OSRM.coordinates[i].first}, osrm::util::FloatLatitude{OSRM.coordinates[i].second}});
+                    osrm::engine::api::ResultT result = osrm::json::Object();
+                    if (OSRM.datasets[d]->engine->osrm().Nearest(params, result) != osrm::Status::Ok) continue;
+
+                    auto &waypoints = std::get<osrm::json::Array>(std::get<osrm::json::Object>(result).values["waypoints"]);
+                    if (waypoints.values.empty()) continue;
+                    auto &waypoint = std::get<osrm::json::Object>(waypoints.values.at(0));
+                    distances[static_cast<size_t>(i) * num_datasets + d] = std::get<osrm::json::Number>(waypoint.values["distance"]).value;
+                }
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    // A location is bad if any dataset can't snap it close enough
+    std::vector<char> bad(n, 0);
+    std::vector<double> worst;
+    worst.reserve(n);
+    for (int i = 0; i < n; ++i) {
+        double max_distance = 0;
+        for (int d = 0; d < num_datasets; ++d) {
+            const double distance = distances[static_cast<size_t>(i) * num_datasets + d];
+            if (distance < 0 || distance > OSRM.max_snap_distance) bad[i] = 1;
+            if (distance >= 0) max_distance = std::max(max_distance, distance);
+        }
+        worst.push_back(max_distance);
+    }
+
+    const std::string report = OSRM.output_dir + "/snap_report.csv";
+    std::filesystem::create_directories(OSRM.output_dir);
+    std::ofstream out(report);
+    out << "index,longitude,latitude";
+    for (const auto &dataset : OSRM.datasets) out << "," << dataset->name << "_snap_distance";
+    out << ",status\n" << std::setprecision(10);
+    int num_bad = 0;
+    for (int i = 0; i < n; ++i) {
+        out << i << "," << OSRM.coordinates[i].first << "," << OSRM.coordinates[i].second;
+        for (int d = 0; d < num_datasets; ++d) out << "," << distances[static_cast<size_t>(i) * num_datasets + d];
+        out << "," << (!bad[i] ? "ok" : OSRM.snap_exclude ? "excluded" : "flagged") << "\n";
+        num_bad += bad[i];
+    }
+    out.close();
+
+    std::sort(worst.begin(), worst.end());
+    std::cout << " - Snapped " << n << " locations: median " << worst[n / 2] << " m, p95 " << worst[std::min(n - 1, n * 95 / 100)]
+              << " m, max " << worst.back() << " m; " << num_bad << " beyond " << OSRM.max_snap_distance << " m or unsnappable ("
+              << (OSRM.snap_exclude ? "excluded" : "flagged") << "), report written to: " << report << std::endl;
+
+    if (OSRM.snap_exclude) {
+        std::vector<std::pair<double, double>> kept;
+        kept.reserve(n - num_bad);
+        for (int i = 0; i < n; ++i) {
+            if (!bad[i]) kept.push_back(OSRM.coordinates[i]);
+        }
+        OSRM.coordinates.swap(kept);
+        OSRM.Number_of_locations = static_cast<int>(OSRM.coordinates.size());
+        OSRM.snap_flagged.clear();
+        if (OSRM.Number_of_locations == 0) {
+            std::cerr << "No locations left after the snap filter.\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+    else {
+        OSRM.snap_flagged.assign(bad.begin(), bad.end());
+    }
 }
 
-// Haversie travel calculation (vogelvlucht)
-inline double haversine(const double &lat1, const double &lon1, const double &lat2, const double &lon2) {
-    double Lat1 = degreesToRadians(lat1);
-    double Lon1 = degreesToRadians(lon1);
-    double Lat2 = degreesToRadians(lat2);
-    double Lon2 = degreesToRadians(lon2);
+// Fill the cells of flagged (unsnappable) locations in the rows [first_row, first_row + rows) with the
+// outside-extract fallback: one snap lookup instead of 2N failing routes. Routing skips cells already set.
+inline void prefill_flagged_locations(osrm_params& OSRM, double **coordinates, int first_row, int rows) {
+    if (OSRM.snap_flagged.empty()) return;
+    const fallback_rule &rule = OSRM.fallback.rule(ROUTE_OUTSIDE_EXTRACT);
+    auto fill = [&](int i, int j) {
+        if (i == j) return;
+        const int distance = static_cast<int>(static_cast<int>(haversine(coordinates[i][1], coordinates[i][0], coordinates[j][1], coordinates[j][0])) * rule.detour);
+        const int time = static_cast<int>(distance / rule.speed);
+        for (auto &dataset : OSRM.datasets) {
+            dataset->TravelDistances.set(i - first_row, j, distance);
+            dataset->TravelTimes.set(i - first_row, j, time);
+            dataset->RouteStatus.set(i - first_row, j, ROUTE_OUTSIDE_EXTRACT);
+        }
+    };
 
-    double dlon = Lon2 - Lon1;
-    double dlat = Lat2 - Lat1;
+    for (int i = first_row; i < first_row + rows; ++i) {
+        if (OSRM.snap_flagged[i]) {
+            for (int j = 0; j < OSRM.Number_of_locations; ++j) fill(i, j);
+        }
+        else {
+            for (int j = 0; j < OSRM.Number_of_locations; ++j) {
+                if (OSRM.snap_flagged[j]) fill(i, j);
+            }
+        }
+    }
+}
 
-    double a = pow(sin(dlat / 2), 2) + cos(Lat1) * cos(Lat2) * pow(sin(dlon / 2), 2);
-    double c = 2 * atan2(sqrt(a), sqrt(1 - a));
+// Run `proc(node)` on OSRM.max_threads routing workers until they all return. With NUMA placement the workers
+// are pinned per node and route on the engine replica of `node`, otherwise they follow OSRM.affinity (if set).
+// A worker is idle from when it returns until the last one finishes.
+inline void run_route_workers(osrm_params& OSRM, const std::function<void(int node)> &proc, stage_clock &clock) {
+    const int num_threads = OSRM.max_threads;
+    const std::vector<int> thread_node = OSRM.numa ? assign_threads_to_nodes(OSRM.numa_nodes, num_threads) : std::vector<int>();
 
-    return EARTH_RADIUS * c * 1000; // Multiply by 1000 to get the result in meters
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::chrono::steady_clock::time_point> finished(num_threads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        const int node = thread_node.empty() ? 0 : thread_node[t];
+        threads.emplace_back([t, node, &thread_node, &OSRM, &proc, &finished]() {
+            if (!thread_node.empty()) pin_current_thread(OSRM.numa_nodes[node].cpus);
+            else if (!OSRM.affinity.empty()) pin_current_thread({OSRM.affinity[t % OSRM.affinity.size()]});
+            proc(node);
+            finished[t] = std::chrono::steady_clock::now();
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    const auto end = std::chrono::steady_clock::now();
+    for (const auto &f : finished) {
+        clock.add_time(end - start);
+        clock.add_idle(end - f);
+    }
 }
 
-// Fill in with haversine
-inline void haversineEngineParallel(int **&depotTravelDistancesHaversine, const int &coordinates1Size, const int &coordinates2Size,
-                                    double **&coordinates1, double **&coordinates2, osrm_params& OSRM) {
-    int num_threads = OSRM.max_threads;
-    auto run_parallel = [coordinates1Size, coordinates2Size, num_threads](auto proc) {
-        int payload_size = (coordinates1Size * coordinates2Size + num_threads - 1) / num_threads;
-        std::vector<std::thread> threads;
-        for (int i = 0; i < num_threads; ++i) {
-            int start_i = i * payload_size;
-            int end_i = std::min(coordinates1Size * coordinates2Size, (i + 1) * payload_size);
-            threads.emplace_back([start_i, end_i, &proc]() { proc(start_i, end_i); });
+// Osrm engine to calculate the routing data for every dataset. The route parameters and the worker
+// threads are shared: each worker routes its pairs on all datasets in turn.
+// The rows are cut into blocks of about the same number of pairs; workers claim the next block until none
+// are left and report every finished block to `progress`, so the writers can stream the rows behind them.
+// With NUMA placement every node owns a contiguous range of blocks (in proportion to its workers), so a
+// node routes one contiguous range of rows; a node whose range is done helps the others from their end.
+// With `symmetric` only the pairs i < j of the (square) matrix are routed; the matrices store a
+// packed triangle, so (j, i) reads the result of (i, j). With `counters` every worker counts hardware events.
+inline void osrmEngine(std::vector<std::unique_ptr<osrm_dataset>> &datasets, const int &coordinates1Size, const int &coordinates2Size,
+                       double **&coordinates1, double **&coordinates2, osrm_params& OSRM, row_progress &progress, stage_clock &clock,
+                       bool symmetric = false, perf_totals *counters = nullptr) {
+    // Rows and columns are visited in the order of OSRM.route_curve (file order without one)
+    const std::vector<int> row_order = curve_order(OSRM.route_curve, coordinates1, coordinates1Size);
+    const std::vector<int> col_order = curve_order(OSRM.route_curve, coordinates2, coordinates2Size);
+
+    // Blocks of consecutive rows of row_order with about ROUTE_BLOCK_PAIRS pairs (a triangle row i has n - 1 - i pairs)
+    const int64_t ROUTE_BLOCK_PAIRS = 16384;
+    std::vector<int> block_start = {0};
+    int64_t pairs = 0;
+    for (int p = 0; p < coordinates1Size; ++p) {
+        pairs += symmetric ? coordinates1Size - 1 - row_order[p] : coordinates2Size;
+        if (pairs >= ROUTE_BLOCK_PAIRS || p + 1 == coordinates1Size) {
+            block_start.push_back(p + 1);
+            pairs = 0;
         }
-        for (auto &t : threads) {
-            t.join();
+    }
+    const int number_of_blocks = static_cast<int>(block_start.size()) - 1;
+    if (number_of_blocks == 0) return;
+
+    // Diagnostics of failing routes, rate limited so a badly clipped extract doesn't flood the output
+    DiagnosticLog log(ROUTE_STATUS_COUNT);
+
+    // Block range [first, last) of every node: claimed from the front by its own workers, from the back by
+    // the workers of other nodes once their range is done
+    const std::vector<int> thread_node = OSRM.numa ? assign_threads_to_nodes(OSRM.numa_nodes, OSRM.max_threads) : std::vector<int>();
+    const int num_nodes = thread_node.empty() ? 1 : static_cast<int>(OSRM.numa_nodes.size());
+    std::vector<int> node_threads(num_nodes, thread_node.empty() ? OSRM.max_threads : 0);
+    for (int node : thread_node) ++node_threads[node];
+    struct block_range {
+        std::mutex mutex;
+        int first = 0, last = 0;
+    };
+    std::vector<block_range> ranges(num_nodes);
+    for (int node = 0, threads_before = 0; node < num_nodes; threads_before += node_threads[node++]) {
+        ranges[node].first = static_cast<int>(static_cast<int64_t>(number_of_blocks) * threads_before / std::max(1, OSRM.max_threads));
+        ranges[node].last = static_cast<int>(static_cast<int64_t>(number_of_blocks) * (threads_before + node_threads[node]) / std::max(1, OSRM.max_threads));
+    }
+    ranges[num_nodes - 1].last = number_of_blocks;
+    auto claim_block = [&](int node) {
+        for (int k = 0; k < num_nodes; ++k) {
+            block_range &range = ranges[(node + k) % num_nodes];
+            std::lock_guard<std::mutex> lock(range.mutex);
+            if (range.first < range.last) return k == 0 ? range.first++ : --range.last;
+        }
+        return -1;
+    };
+
+    // OSRM calculation
+    auto osrm_proc = [&](int node) {
+        osrm::RouteParameters params;
+        params.overview = osrm::RouteParameters::OverviewType::False;
+        // params.generate_hints = false;
+
+        thread_counters counted(counters);
+        int64_t routed = 0;
+        for (int b = claim_block(node); b >= 0; b = claim_block(node)) {
+            for (int p = block_start[b]; p < block_start[b + 1]; ++p) {
+                const int i1 = row_order[p];
+                for (int i2 : col_order) {
+                    // A triangle only holds the cells right of the diagonal
+                    if (symmetric && i2 <= i1) continue;
+                    for (auto &dataset : datasets) {
+                        if (dataset->TravelTimes.is_set(i1, i2)) continue;
+                        int result_distance = 0;
+                        int result_time = 0;
+                        const uint8_t status = dataset->engine_for(node).route(params, coordinates1[i1], coordinates2[i2], log, result_distance, result_time);
+                        ++routed;
+
+                        dataset->TravelDistances.set(i1, i2, result_distance);
+                        dataset->TravelTimes.set(i1, i2, result_time);
+                        if (status != ROUTE_OK) dataset->RouteStatus.set(i1, i2, status);
+                    }
+                }
+            }
+            if (OSRM.route_curve == curve_type::None) progress.complete(block_start[b], block_start[b + 1]);
+            else for (int p = block_start[b]; p < block_start[b + 1]; ++p) progress.complete(row_order[p], row_order[p] + 1);
         }
-        threads.clear();
+        if (counters) counters->cells += routed;
     };
 
-    auto haversine_proc = [&](int start_i, int end_i) {
-        for (int i = start_i; i < end_i; ++i) {
-            int i1 = i / coordinates2Size;
-            int i2 = i % coordinates2Size;
-            double lat1 = coordinates1[i1][1];
-            double lon1 = coordinates1[i1][0];
-            double lat2 = coordinates2[i2][1];
-            double lon2 = coordinates2[i2][0];
-            depotTravelDistancesHaversine[i1][i2] = static_cast<int>(haversine(lat1, lon1, lat2, lon2));
+    run_route_workers(OSRM, osrm_proc, clock);
+    log.flush(route_status_name);
+}
+
+// Random origin-destination pairs (origin != destination) for the benchmarks, seeded for repeatable runs
+inline std::vector<std::pair<int, int>> benchmark_pairs(const osrm_params& OSRM, int count) {
+    std::vector<std::pair<int, int>> pairs;
+    if (OSRM.Number_of_locations < 2) return pairs;
+    std::mt19937_64 rng(OSRM.seed);
+    std::uniform_int_distribution<int> pick(0, OSRM.Number_of_locations - 1);
+    while (static_cast<int>(pairs.size()) < count) {
+        const int i = pick(rng), j = pick(rng);
+        if (i != j) pairs.emplace_back(i, j);
+    }
+    return pairs;
+}
+
+// Routes per second of `num_threads` workers routing `pairs` on the first dataset. With `use_nodes` > 0 the
+// workers are spread over (and pinned to) the first `use_nodes` NUMA nodes and use their engine replicas.
+inline double route_throughput(osrm_params& OSRM, double **coordinates, const std::vector<std::pair<int, int>> &pairs, int num_threads, int use_nodes) {
+    auto &dataset = *OSRM.datasets.front();
+    std::vector<numa_node> nodes;
+    if (use_nodes > 0) nodes.assign(OSRM.numa_nodes.begin(), OSRM.numa_nodes.begin() + use_nodes);
+    const std::vector<int> thread_node = assign_threads_to_nodes(nodes, num_threads);
+
+    DiagnosticLog log(ROUTE_STATUS_COUNT, 0);
+    const int payload_size = (static_cast<int>(pairs.size()) + num_threads - 1) / num_threads;
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        const int start_i = t * payload_size;
+        const int end_i = std::min(static_cast<int>(pairs.size()), (t + 1) * payload_size);
+        const int node = thread_node.empty() ? 0 : thread_node[t];
+        threads.emplace_back([&, t, start_i, end_i, node]() {
+            if (!nodes.empty()) pin_current_thread(nodes[node].cpus);
+            else if (!OSRM.affinity.empty()) pin_current_thread({OSRM.affinity[t % OSRM.affinity.size()]});
+            osrm::RouteParameters params;
+            params.overview = osrm::RouteParameters::OverviewType::False;
+            int distance, time;
+            for (int k = start_i; k < end_i; ++k) {
+                dataset.engine_for(node).route(params, coordinates[pairs[k].first], coordinates[pairs[k].second], log, distance, time);
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return pairs.size() / std::max(seconds, 1e-9);
+}
+
+// Scaling from one to all NUMA nodes: route the same random pairs with the CPUs of the first k nodes
+inline void benchmark_numa_scaling(osrm_params& OSRM, double **coordinates, int count) {
+    const auto pairs = benchmark_pairs(OSRM, count);
+    if (pairs.empty()) return;
+
+    double base = 0;
+    int num_threads = 0;
+    for (int k = 1; k <= static_cast<int>(OSRM.numa_nodes.size()); ++k) {
+        num_threads += static_cast<int>(OSRM.numa_nodes[k - 1].cpus.size());
+        const double throughput = route_throughput(OSRM, coordinates, pairs, num_threads, k);
+        if (k == 1) base = throughput;
+        std::cout << " - NUMA benchmark: " << k << " node(s), " << num_threads << " threads: " << std::fixed << std::setprecision(0)
+                  << throughput << " routes/s (x" << std::setprecision(2) << throughput / base << ")" << std::defaultfloat << std::endl;
+    }
+}
+
+// Scaling over the routing thread count: route the same random pairs with 1, 2, 4, ... up to max_threads
+inline void benchmark_thread_scaling(osrm_params& OSRM, double **coordinates, int count) {
+    const auto pairs = benchmark_pairs(OSRM, count);
+    if (pairs.empty()) return;
+
+    std::vector<int> thread_counts;
+    for (int t = 1; t < OSRM.max_threads; t *= 2) thread_counts.push_back(t);
+    thread_counts.push_back(OSRM.max_threads);
+
+    double base = 0;
+    for (int num_threads : thread_counts) {
+        const double throughput = route_throughput(OSRM, coordinates, pairs, num_threads, 0);
+        if (num_threads == 1) base = throughput;
+        std::cout << " - Thread benchmark: " << num_threads << " threads: " << std::fixed << std::setprecision(0) << throughput
+                  << " routes/s (x" << std::setprecision(2) << throughput / base << ", efficiency "
+                  << std::setprecision(0) << 100.0 * throughput / (base * num_threads) << "%)" << std::defaultfloat << std::endl;
+    }
+}
+
+// Benchmark the route order: route the pairs between about sqrt(count) random locations once in file order and
+// once along OSRM.route_curve, every worker taking a contiguous share of the pairs, and compare the throughput.
+// Random locations are scattered over the map, like a large unsorted input.
+inline void benchmark_route_order(osrm_params& OSRM, double **coordinates, int count) {
+    const int n = OSRM.Number_of_locations;
+    const int m = std::min(n, static_cast<int>(std::ceil(std::sqrt(static_cast<double>(count)))));
+    if (m < 2) return;
+    std::vector<int> sample(n);
+    for (int i = 0; i < n; ++i) sample[i] = i;
+    std::mt19937_64 rng(OSRM.seed);
+    std::shuffle(sample.begin(), sample.end(), rng);
+    sample.resize(m);
+
+    auto all_pairs = [](const std::vector<int> &locations) {
+        std::vector<std::pair<int, int>> pairs;
+        for (int i : locations) {
+            for (int j : locations) {
+                if (i != j) pairs.emplace_back(i, j);
+            }
         }
+        return pairs;
     };
+    std::vector<int> curve_sample = sample;
+    std::sort(curve_sample.begin(), curve_sample.end(), [&](int a, int b) {
+        return curve_key(OSRM.route_curve, coordinates[a][0], coordinates[a][1]) < curve_key(OSRM.route_curve, coordinates[b][0], coordinates[b][1]);
+    });
 
-    run_parallel(haversine_proc);
+    // Warm up the page cache so the first order measured isn't penalised
+    const auto file_pairs = all_pairs(sample), curve_pairs = all_pairs(curve_sample);
+    route_throughput(OSRM, coordinates, std::vector<std::pair<int, int>>(file_pairs.begin(), file_pairs.begin() + std::min<size_t>(file_pairs.size(), 1000)),
+                     OSRM.max_threads, 0);
+    const double file_throughput = route_throughput(OSRM, coordinates, file_pairs, OSRM.max_threads, 0);
+    const double curve_throughput = route_throughput(OSRM, coordinates, curve_pairs, OSRM.max_threads, 0);
+    std::cout << " - Route order benchmark (" << m << " x " << m << " locations, " << OSRM.max_threads << " threads): file order " << std::fixed
+              << std::setprecision(0) << file_throughput << " routes/s, " << curve_name(OSRM.route_curve) << " " << curve_throughput
+              << " routes/s (x" << std::setprecision(2) << curve_throughput / file_throughput << ")" << std::defaultfloat << std::endl;
 }
 
-// Osrm engine to calculate the routing data
-inline void osrmEngine(int **&travel_distances, int **&travel_times, const int &coordinates1Size, const int &coordinates2Size,
-                       double **&coordinates1, double **&coordinates2, osrm_params& OSRM) {
-    // map loactions (index of travel matrices) to transport numbers
-    std::unique_ptr<int[]> haversineDistances = std::make_unique<int[]>(coordinates1Size * coordinates2Size);
-    
-    int num_threads = OSRM.max_threads;
-    // lambda function for running parallel
-    auto run_parallel = [coordinates1Size, coordinates2Size, num_threads](auto proc) {
-        int payload_size = (coordinates1Size * coordinates2Size + num_threads - 1) / num_threads;
+// Mean, median, p95 and max of relative errors (non-empty), as percentages
+inline std::string error_summary(std::vector<double> &errors) {
+    std::sort(errors.begin(), errors.end());
+    double mean = 0;
+    for (double e : errors) mean += e;
+    mean /= errors.size();
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << "mean " << mean * 100 << "%, median " << errors[errors.size() / 2] * 100
+        << "%, p95 " << errors[std::min(errors.size() - 1, errors.size() * 95 / 100)] * 100 << "%, max " << errors.back() * 100 << "%";
+    return out.str();
+}
+
+// Audit the symmetric approximation: route `samples` random pairs (j, i) with i < j, whose results were
+// mirrored from (i, j), and report how far the true reverse routes are from the mirrored values.
+inline void audit_symmetry(osrm_params& OSRM, double **coordinates, int samples) {
+    const int n = OSRM.Number_of_locations;
+    if (n < 2 || samples <= 0) return;
+
+    std::mt19937_64 rng(OSRM.seed);
+    std::uniform_int_distribution<int> pick(0, n - 1);
+    std::vector<std::pair<int, int>> pairs;
+    while (static_cast<int>(pairs.size()) < samples) {
+        int i = pick(rng), j = pick(rng);
+        if (i == j) continue;
+        pairs.emplace_back(std::min(i, j), std::max(i, j));
+    }
+
+    DiagnosticLog log(ROUTE_STATUS_COUNT);
+    for (auto &dataset : OSRM.datasets) {
+        std::vector<double> time_errors(pairs.size()), distance_errors(pairs.size());
+        int num_threads = std::max(1, std::min<int>(OSRM.max_threads, static_cast<int>(pairs.size())));
+        int payload_size = (static_cast<int>(pairs.size()) + num_threads - 1) / num_threads;
         std::vector<std::thread> threads;
-        for (int i = 0; i < num_threads; ++i) {
-            int start_i = i * payload_size;
-            int end_i = std::min(coordinates1Size * coordinates2Size, (i + 1) * payload_size);
-            threads.emplace_back([start_i, end_i, &proc]() { proc(start_i, end_i); });
+        for (int t = 0; t < num_threads; ++t) {
+            int start_i = t * payload_size;
+            int end_i = std::min(static_cast<int>(pairs.size()), (t + 1) * payload_size);
+            threads.emplace_back([&, start_i, end_i]() {
+                osrm::RouteParameters params;
+                params.overview = osrm::RouteParameters::OverviewType::False;
+                for (int k = start_i; k < end_i; ++k) {
+                    const int i = pairs[k].first, j = pairs[k].second;
+                    int reverse_distance = 0, reverse_time = 0;
+                    dataset->engine->route(params, coordinates[j], coordinates[i], log, reverse_distance, reverse_time);
+                    // Relative error of the mirrored value with respect to the true reverse route
+                    time_errors[k] = std::abs(dataset->TravelTimes.get(i, j) - reverse_time) / std::max(1.0, static_cast<double>(reverse_time));
+                    distance_errors[k] = std::abs(dataset->TravelDistances.get(i, j) - reverse_distance) / std::max(1.0, static_cast<double>(reverse_distance));
+                }
+            });
+        }
+        for (auto &t : threads) {
+            t.join();
         }
 
+        std::cout << " - Symmetry audit " << dataset->name << " (" << pairs.size() << " reverse pairs): time error " << error_summary(time_errors)
+                  << "; distance error " << error_summary(distance_errors) << std::endl;
+    }
+}
+
+// Export the full route geometry of the pairs in OSRM.geometry_pairs_path for every dataset. This runs after
+// the matrices with its own route parameters (full overview, polyline6), so the matrix routing never pays for
+// it; routes are streamed to the geometry file as they complete.
+inline void export_geometries(osrm_params& OSRM, double **coordinates) {
+    std::vector<std::pair<int, int>> pairs;
+    if (!load_geometry_pairs(OSRM.geometry_pairs_path, OSRM.Number_of_locations, pairs)) return;
+
+    for (auto &dataset : OSRM.datasets) {
+        const std::string filename = OSRM.output_path(*dataset, "geometries.osrmgeo");
+        GeometryFileWriter writer;
+        if (!writer.open(filename, pairs.size(), OSRM.geometry_annotations)) continue;
+
+        int num_threads = std::max(1, std::min<int>(OSRM.max_threads, static_cast<int>(pairs.size())));
+        int payload_size = (static_cast<int>(pairs.size()) + num_threads - 1) / num_threads;
+        std::vector<int> failed(num_threads, 0);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; ++t) {
+            int start_i = t * payload_size;
+            int end_i = std::min(static_cast<int>(pairs.size()), (t + 1) * payload_size);
+            threads.emplace_back([&, t, start_i, end_i]() {
+                osrm::RouteParameters params;
+                params.overview = osrm::RouteParameters::OverviewType::Full;
+                params.geometries = osrm::RouteParameters::GeometriesType::Polyline6;
+                if (OSRM.geometry_annotations) {
+                    params.annotations = true;
+                    params.annotations_type = osrm::RouteParameters::AnnotationsType::Duration | osrm::RouteParameters::AnnotationsType::Distance;
+                }
+
+                std::vector<float> durations, distances;
+                for (int k = start_i; k < end_i; ++k) {
+                    const int from = pairs[k].first, to = pairs[k].second;
+                    params.coordinates.clear();
+                    params.coordinates.push_back({osrm::util::FloatLongitude{coordinates[from][0]}, osrm::util::FloatLatitude{coordinates[from][1]}});
+                    params.coordinates.push_back({osrm::util::FloatLongitude{coordinates[to][0]}, osrm::util::FloatLatitude{coordinates[to][1]}});
+
+                    osrm::engine::api::ResultT result = osrm::json::Object();
+                    if (dataset->engine->osrm().Route(params, result) != osrm::Status::Ok) {
+                        writer.add_failed(k, from, to);
+                        ++failed[t];
+                        continue;
+                    }
+
+                    auto &json_result = std::get<osrm::json::Object>(result);
+                    auto &route = std::get<osrm::json::Object>(std::get<osrm::json::Array>(json_result.values["routes"]).values.at(0));
+                    durations.clear();
+                    distances.clear();
+                    if (OSRM.geometry_annotations) {
+                        // A pair is a single leg
+                        auto &legs = std::get<osrm::json::Array>(route.values["legs"]);
+                        auto &annotation = std::get<osrm::json::Object>(std::get<osrm::json::Object>(legs.values.at(0)).values["annotation"]);
+                        for (auto &v : std::get<osrm::json::Array>(annotation.values["duration"]).values) durations.push_back(static_cast<float>(std::get<osrm::json::Number>(v).value));
+                        for (auto &v : std::get<osrm::json::Array>(annotation.values["distance"]).values) distances.push_back(static_cast<float>(std::get<osrm::json::Number>(v).value));
+                    }
+                    writer.add(k, from, to, std::get<osrm::json::Number>(route.values["distance"]).value,
+                               std::get<osrm::json::Number>(route.values["duration"]).value,
+                               std::get<osrm::json::String>(route.values["geometry"]).value, durations, distances);
+                }
+            });
+        }
         for (auto &t : threads) {
             t.join();
         }
-        threads.clear();
+
+        int total_failed = 0;
+        for (int f : failed) total_failed += f;
+        if (!writer.close()) {
+            std::cerr << "Failed to write geometry file: " << filename << std::endl;
+            continue;
+        }
+        std::cout << " - Route geometries written to: " << filename << " (" << pairs.size() - total_failed << " routes";
+        if (total_failed > 0) std::cout << ", " << total_failed << " without route";
+        std::cout << ")" << std::endl;
+    }
+}
+
+// Output files are written by a separate, I/O bound pool: every job writes one file
+using output_jobs = std::vector<std::function<void()>>;
+
+// The time spent in the jobs is added to `clock` (if given).
+inline void run_output_jobs(output_jobs &jobs, int num_threads, stage_clock *clock = nullptr) {
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < std::min<int>(std::max(1, num_threads), static_cast<int>(jobs.size())); ++t) {
+        threads.emplace_back([&jobs, &next, clock]() {
+            for (size_t k = next++; k < jobs.size(); k = next++) {
+                const auto start = std::chrono::steady_clock::now();
+                jobs[k]();
+                if (clock) clock->add_time(std::chrono::steady_clock::now() - start);
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    jobs.clear();
+}
+
+// Create the directory of output file `filename` and open it for writing; false (with a message) on failure
+inline bool open_output(const std::string &filename, std::ofstream &out) {
+    try {
+        std::filesystem::path p(filename);
+        if (!p.parent_path().empty()) std::filesystem::create_directories(p.parent_path());
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Failed to create output directory for: " << filename << " -> " << e.what() << std::endl;
+        return false;
+    }
+    out.open(filename);
+    if (!out.is_open()) {
+        std::cerr << "Failed to open output file: " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Print how the `stage` ("routing", "estimating") of a run overlapped with writing its `num_files` outputs:
+// the stage took `stage_seconds` for `cells` cells, the writers finished `total_seconds` after its start
+inline void report_pipeline(const std::string &stage, double stage_seconds, double total_seconds, int64_t cells, int workers,
+                            const stage_clock &work_clock, const stage_clock &write_clock, size_t num_files) {
+    std::cout << std::fixed << std::setprecision(1) << " - Pipeline: " << stage << " " << stage_seconds << " s (" << workers << " workers, busy "
+              << work_clock.busy_share() * 100 << "%, " << std::setprecision(0) << (stage_seconds > 0 ? cells / stage_seconds : 0.0)
+              << " cells/s), writing " << num_files << " files done " << std::setprecision(1) << total_seconds - stage_seconds << " s after "
+              << stage << " (busy " << write_clock.busy_seconds() << " s, waiting on " << stage << " " << write_clock.idle_seconds() << " s)"
+              << std::defaultfloat << std::endl;
+}
+
+// Report how the cells of every dataset were obtained
+inline void report_route_status(osrm_params& OSRM) {
+    for (const auto &dataset : OSRM.datasets) {
+        const auto counts = dataset->RouteStatus.counts();
+        std::cout << " - " << dataset->name << " route status:";
+        for (int s = 0; s < ROUTE_STATUS_COUNT; ++s) std::cout << " " << route_status_name(s) << " " << counts[s];
+        std::cout << std::endl;
+    }
+}
+
+// Write the route status matrices (one status code per cell, see RouteStatus.h) to CSV files.
+// Every row is written once `wait` says it is complete.
+inline void write_route_status_csv(osrm_params& OSRM, const row_wait_fn &wait, output_jobs &jobs) {
+    for (const auto &dataset : OSRM.datasets) {
+        const std::string filename = OSRM.output_path(*dataset, "route_status.csv");
+        const RouteStatusMatrix &status = dataset->RouteStatus;
+        jobs.emplace_back([filename, wait, &status]() {
+            std::ofstream out;
+            if (!open_output(filename, out)) return;
+
+            std::string line;
+            for (int i = 0; i < status.rows(); ++i) {
+                if (wait) wait(i);
+                line.clear();
+                for (int j = 0; j < status.cols(); ++j) {
+                    if (j) line += ',';
+                    line += static_cast<char>('0' + status.get(i, j));
+                }
+                line += '\n';
+                out << line;
+            }
+            std::cout << " - Route status written to: " + filename + "\n" << std::flush;
+        });
+    }
+}
+
+// Write matrices to CSV files, every row once `wait` says it is complete. With `counters` every writer
+// counts hardware events.
+inline void write_matrix_csv(osrm_params& OSRM, const row_wait_fn &wait, output_jobs &jobs, perf_totals *counters = nullptr) {
+    auto matrix_csv = [wait, counters](const std::string &filename, const TravelMatrix &matrix) -> bool {
+        std::ofstream out;
+        if (!open_output(filename, out)) return false;
+
+        const int n = matrix.cols();
+        std::vector<int> row(n);
+        thread_counters counted(counters);
+        for (int i = 0; i < matrix.rows(); ++i) {
+            if (wait) wait(i);
+            matrix.get_row(i, row.data());
+            for (int j = 0; j < n; ++j) {
+                out << row[j];
+                if (j + 1 < n) out << ',';
+            }
+            out << '\n';
+        }
+        out.close();
+        if (counters) counters->cells += static_cast<int64_t>(matrix.rows()) * n;
+        return true;
     };
 
-    // Haversine calculation
-    auto harvestine_proc = [&](int start_i, int end_i) {
-        for (int i = start_i; i < end_i; ++i) {
-            int i1 = i / coordinates2Size;
-            int i2 = i % coordinates2Size;
-            auto haversineDistance = haversine(coordinates1[i1][1], coordinates1[i1][0], coordinates2[i2][1], coordinates2[i2][0]);
-            haversineDistances[i] = haversineDistance;
+    for (const auto &dataset : OSRM.datasets) {
+        const std::string dist_file = OSRM.output_path(*dataset, "travel_distances.csv");
+        const std::string time_file = OSRM.output_path(*dataset, "travel_times.csv");
+        const TravelMatrix &distances = dataset->TravelDistances;
+        const TravelMatrix &times = dataset->TravelTimes;
+
+        jobs.emplace_back([matrix_csv, dist_file, &distances]() {
+            if (matrix_csv(dist_file, distances)) {
+                std::cout << " - Travel distances written to: " + dist_file + "\n" << std::flush;
+            }
+            else {
+                std::cerr << " - Failed to write travel distances to CSV." << std::endl;
+            }
+        });
+
+        jobs.emplace_back([matrix_csv, time_file, &times]() {
+            if (matrix_csv(time_file, times)) {
+                std::cout << " - Travel times written to: " + time_file + "\n" << std::flush;
+            }
+            else {
+                std::cerr << " - Failed to write travel times to CSV." << std::endl;
+            }
+        });
+    }
+}
+
+// Write matrices to binary matrix files (raw codes or row-delta + zstd, see MatrixFile.h)
+inline void write_matrix_binary(osrm_params& OSRM, bool compressed, const row_wait_fn &wait, output_jobs &jobs) {
+    const std::string extension = compressed ? ".mtx.zst" : ".mtx";
+    auto matrix_binary = [compressed, wait](const std::string &filename, const TravelMatrix &matrix, const std::string &label) {
+        if (write_matrix_file(filename, matrix, compressed, wait)) {
+            std::cout << " - Travel " + label + " written to: " + filename + " (" + std::to_string(std::filesystem::file_size(filename)) + " bytes)\n" << std::flush;
+        }
+        else {
+            std::cerr << " - Failed to write travel " << label << " to " << filename << std::endl;
         }
     };
 
-    // Execute harvestine in parallel
-    run_parallel(harvestine_proc);
+    for (const auto &dataset : OSRM.datasets) {
+        const std::string dist_file = OSRM.output_path(*dataset, "travel_distances" + extension);
+        const std::string time_file = OSRM.output_path(*dataset, "travel_times" + extension);
+        const TravelMatrix &distances = dataset->TravelDistances;
+        const TravelMatrix &times = dataset->TravelTimes;
 
-    // OSRM calculation
-    auto osrm_proc = [&](int start_i, int end_i) {
+        jobs.emplace_back([matrix_binary, dist_file, &distances]() { matrix_binary(dist_file, distances, "distances"); });
+        jobs.emplace_back([matrix_binary, time_file, &times]() { matrix_binary(time_file, times, "times"); });
+    }
+}
+
+// Write matrices to Arrow IPC stream or Parquet tables (see TableFile.h). Row numbers start at `first_row`,
+// every batch is written once `wait` says its rows are complete.
+inline void write_matrix_table(osrm_params& OSRM, TableFormat format, int first_row, const row_wait_fn &wait, output_jobs &jobs) {
+    const std::string extension = table_file_extension(format);
+    auto done = [](bool ok, const std::string &label, const std::string &filename) {
+        if (ok) std::cout << " - Travel " + label + " written to: " + filename + " (" + std::to_string(std::filesystem::file_size(filename)) + " bytes)\n" << std::flush;
+        else std::cerr << " - Failed to write travel " << label << " to " << filename << std::endl;
+    };
+
+    for (const auto &dataset : OSRM.datasets) {
+        const TravelMatrix &distances = dataset->TravelDistances;
+        const TravelMatrix &times = dataset->TravelTimes;
+        if (OSRM.table_layout == TableLayout::Long) {
+            const std::string file = OSRM.output_path(*dataset, "travel_matrix" + extension);
+            const RouteStatusMatrix &status = dataset->RouteStatus;
+            jobs.emplace_back([done, file, format, first_row, wait, &times, &distances, &status]() {
+                done(write_matrix_table_long(file, format, times, distances, status, first_row, wait), "matrix", file);
+            });
+        }
+        else {
+            const std::string dist_file = OSRM.output_path(*dataset, "travel_distances" + extension);
+            const std::string time_file = OSRM.output_path(*dataset, "travel_times" + extension);
+            jobs.emplace_back([done, dist_file, format, first_row, wait, &distances]() { done(write_matrix_table_wide(dist_file, format, distances, first_row, wait), "distances", dist_file); });
+            jobs.emplace_back([done, time_file, format, first_row, wait, &times]() { done(write_matrix_table_wide(time_file, format, times, first_row, wait), "times", time_file); });
+        }
+    }
+}
+
+// Report the memory used by the matrices and values that didn't fit their encoding
+inline void report_matrix_storage(osrm_params& OSRM) {
+    for (const auto &dataset : OSRM.datasets) {
+        const TravelMatrix *matrices[2] = {&dataset->TravelTimes, &dataset->TravelDistances};
+        const char *labels[2] = {"times", "distances"};
+        for (int m = 0; m < 2; ++m) {
+            const TravelMatrix &matrix = *matrices[m];
+            std::cout << " - " << dataset->name << " " << labels[m] << ": " << matrix.encoding().bits << " bit cells of "
+                      << matrix.encoding().unit << ", " << matrix.bytes() << " bytes";
+            if (matrix.overflow_count() > 0) {
+                std::cout << ", " << matrix.overflow_count() << " values clamped to " << matrix.max_value()
+                          << " (use more bits or a larger unit)";
+            }
+            std::cout << std::endl;
+        }
+    }
+}
+
+// Calculate travel times and distances
+// Compute the matrix rows [first_row, first_row + rows) of every dataset and write the requested outputs to
+// OSRM.output_dir. A normal run computes all rows, a shard worker one row shard at a time.
+inline void compute_matrices(osrm_params& OSRM, double **coordinates, int first_row, int rows) {
+    OSRM.allocate_matrices(rows);
+
+    // Matrices start unset, going to the same place gives zero
+    for (int i = first_row; i < first_row + rows; ++i) {
+        for (auto &dataset : OSRM.datasets) {
+            dataset->TravelTimes.set(i - first_row, i, 0);
+            dataset->TravelDistances.set(i - first_row, i, 0);
+        }
+    }
+    prefill_flagged_locations(OSRM, coordinates, first_row, rows);
+
+    // Pipeline: the writers start right away and stream every row as soon as the routing workers completed it
+    stage_clock route_clock, write_clock;
+    row_progress progress(rows, &write_clock);
+    const row_wait_fn wait = progress.waiter();
+
+    // Hardware counters of the routing workers and the csv writers, if requested
+    perf_totals route_perf, write_perf;
+    perf_totals *route_counters = OSRM.perf_counters ? &route_perf : nullptr;
+    perf_totals *write_counters = OSRM.perf_counters ? &write_perf : nullptr;
+
+    // Write matrices in the requested formats, one file per job on the writing pool
+    output_jobs jobs;
+    if (OSRM.output_csv) write_matrix_csv(OSRM, wait, jobs, write_counters);
+    if (OSRM.output_binary) write_matrix_binary(OSRM, false, wait, jobs);
+    if (OSRM.output_compressed) write_matrix_binary(OSRM, true, wait, jobs);
+    if (OSRM.output_status) write_route_status_csv(OSRM, wait, jobs);
+    if (OSRM.output_arrow) write_matrix_table(OSRM, TableFormat::Arrow, first_row, wait, jobs);
+    if (OSRM.output_parquet) write_matrix_table(OSRM, TableFormat::Parquet, first_row, wait, jobs);
+    const size_t num_files = jobs.size();
+    std::thread writers([&]() { run_output_jobs(jobs, OSRM.write_threads, &write_clock); });
+
+    const auto start = std::chrono::steady_clock::now();
+    double **origins = coordinates + first_row;
+    osrmEngine(OSRM.datasets, rows, OSRM.Number_of_locations, origins, coordinates, OSRM, progress, route_clock, OSRM.symmetric && rows == OSRM.Number_of_locations,
+               route_counters);
+    const double route_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << " - Osrm calculations done." << std::endl;
+
+    if (OSRM.symmetric && rows == OSRM.Number_of_locations) audit_symmetry(OSRM, coordinates, OSRM.symmetric_audit_samples);
+
+    report_route_status(OSRM);
+    report_matrix_storage(OSRM);
+
+    writers.join();
+    const double total_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    report_pipeline("routing", route_seconds, total_seconds, static_cast<int64_t>(rows) * OSRM.Number_of_locations * static_cast<int64_t>(OSRM.datasets.size()), OSRM.max_threads, route_clock, write_clock, num_files);
+    if (OSRM.perf_counters) {
+        route_perf.report("routing");
+        if (OSRM.output_csv) write_perf.report("csv writing");
+    }
+}
+
+// A pair kept by the sparse mode
+struct sparse_cell {
+    int to;
+    int time;
+    int distance;
+    uint8_t status;
+};
+
+// Write the kept pairs of every dataset to travel_pairs.csv, one line "from,to,time,distance,status" per pair
+// in row order, every row once `wait` says it is complete. Rows are numbered from `first_row`.
+inline void write_sparse_csv(osrm_params& OSRM, const std::vector<std::vector<std::vector<sparse_cell>>> &kept, int first_row,
+                             const row_wait_fn &wait, output_jobs &jobs) {
+    for (size_t d = 0; d < OSRM.datasets.size(); ++d) {
+        const std::string filename = OSRM.output_path(*OSRM.datasets[d], "travel_pairs.csv");
+        const auto &rows = kept[d];
+        jobs.emplace_back([filename, first_row, wait, &rows]() {
+            std::ofstream out;
+            if (!open_output(filename, out)) return;
+
+            std::string line;
+            for (int i = 0; i < static_cast<int>(rows.size()); ++i) {
+                if (wait) wait(i);
+                line.clear();
+                const std::string from = std::to_string(first_row + i) + ',';
+                for (const sparse_cell &cell : rows[i]) {
+                    line += from;
+                    line += std::to_string(cell.to) + ',' + std::to_string(cell.time) + ',' + std::to_string(cell.distance) + ',';
+                    line += static_cast<char>('0' + cell.status);
+                    line += '\n';
+                }
+                out << line;
+            }
+            std::cout << " - Travel pairs written to: " + filename + "\n" << std::flush;
+        });
+    }
+}
+
+// Sparse mode: keep only the pairs of the rows [first_row, first_row + rows) within OSRM.max_duration and/or
+// OSRM.max_distance. Road distance is at least the straight line distance and can't be covered faster than
+// OSRM.max_speed, so destinations further than that radius are pruned before routing: they are found with a
+// latitude band search over the destinations sorted by latitude and a haversine check. With the snap pre-flight
+// the radius grows by twice max_snap_distance, the most snapping can shorten a route.
+inline void compute_sparse(osrm_params& OSRM, double **coordinates, int first_row, int rows) {
+    const int n = OSRM.Number_of_locations;
+    double radius = std::numeric_limits<double>::infinity();
+    if (OSRM.max_distance > 0) radius = OSRM.max_distance;
+    if (OSRM.max_duration > 0) radius = std::min(radius, OSRM.max_duration * OSRM.max_speed);
+    radius += 2 * OSRM.max_snap_distance;
+    const double band = radius / haversine(0, 0, 1, 0); // Degrees of latitude
+
+    std::vector<int> by_latitude(n);
+    for (int j = 0; j < n; ++j) by_latitude[j] = j;
+    std::sort(by_latitude.begin(), by_latitude.end(), [&](int a, int b) { return coordinates[a][1] < coordinates[b][1]; });
+    std::vector<double> latitudes(n);
+    for (int k = 0; k < n; ++k) latitudes[k] = coordinates[by_latitude[k]][1];
+
+    auto within_budget = [&](int time, int distance) {
+        return (OSRM.max_duration <= 0 || time <= OSRM.max_duration) && (OSRM.max_distance <= 0 || distance <= OSRM.max_distance);
+    };
+
+    // Kept pairs per dataset and row, sorted by destination
+    std::vector<std::vector<std::vector<sparse_cell>>> kept(OSRM.datasets.size(), std::vector<std::vector<sparse_cell>>(rows));
+
+    stage_clock route_clock, write_clock;
+    row_progress progress(rows, &write_clock);
+    output_jobs jobs;
+    write_sparse_csv(OSRM, kept, first_row, progress.waiter(), jobs);
+    const size_t num_files = jobs.size();
+    std::thread writers([&]() { run_output_jobs(jobs, OSRM.write_threads, &write_clock); });
+
+    // Rows vary a lot in candidates (dense centre, empty outskirts), so workers claim small row blocks
+    const int SPARSE_BLOCK_ROWS = 16;
+    const int number_of_blocks = (rows + SPARSE_BLOCK_ROWS - 1) / SPARSE_BLOCK_ROWS;
+    std::atomic<int> next_block{0};
+    std::atomic<int64_t> candidates{0}, routed{0};
+    DiagnosticLog log(ROUTE_STATUS_COUNT);
+    const fallback_rule &outside = OSRM.fallback.rule(ROUTE_OUTSIDE_EXTRACT);
+
+    auto sparse_proc = [&](int node) {
         osrm::RouteParameters params;
         params.overview = osrm::RouteParameters::OverviewType::False;
-        // params.generate_hints = false;
+        std::vector<int> targets;
+        for (int b = next_block++; b < number_of_blocks; b = next_block++) {
+            const int last = std::min(rows, (b + 1) * SPARSE_BLOCK_ROWS);
+            int64_t block_candidates = 0, block_routed = 0;
+            for (int r = b * SPARSE_BLOCK_ROWS; r < last; ++r) {
+                const int i = first_row + r;
+                const double *from = coordinates[i];
+                targets.clear();
+                const auto lo = std::lower_bound(latitudes.begin(), latitudes.end(), from[1] - band);
+                const auto hi = std::upper_bound(latitudes.begin(), latitudes.end(), from[1] + band);
+                for (auto k = lo; k != hi; ++k) {
+                    const int j = by_latitude[k - latitudes.begin()];
+                    if (j != i && haversine(from[1], from[0], coordinates[j][1], coordinates[j][0]) <= radius) targets.push_back(j);
+                }
+                std::sort(targets.begin(), targets.end());
+                block_candidates += targets.size();
 
-        for (int i = start_i; i < end_i; ++i) {
-            int i1 = i / coordinates2Size;
-            int i2 = i % coordinates2Size;
-
-            auto &result_distance = travel_distances[i1][i2];
-            auto &result_time = travel_times[i1][i2];
-            const auto &haversineDistance = haversineDistances[i];
-
-            // if(i1 == 73 && i2 == 102) std::cout << haversineDistance / 1000.0 << std::endl;
-
-            if (result_time == INT32_MAX) {
-                // Route
-                params.coordinates.clear();
-                params.coordinates.push_back({osrm::util::FloatLongitude{coordinates1[i1][0]}, osrm::util::FloatLatitude{coordinates1[i1][1]}});
-                params.coordinates.push_back({osrm::util::FloatLongitude{coordinates2[i2][0]}, osrm::util::FloatLatitude{coordinates2[i2][1]}});
-
-                // Response is in JSON format
-                osrm::engine::api::ResultT result = osrm::json::Object();
-
-                // Execute routing request, this does the heavy lifting
-                const auto status = OSRM.engine->Route(params, result);
-
-                auto &json_result = std::get<osrm::json::Object>(result);
-                if (status == osrm::Status::Ok) {
-                    auto &routes = std::get<osrm::json::Array>(json_result.values["routes"]);
-
-                    // Let's just use the first route
-                    auto &route = std::get<osrm::json::Object>(routes.values.at(0));
-                    auto route_distance = std::get<osrm::json::Number>(route.values["distance"]).value;
-                    auto route_time = std::get<osrm::json::Number>(route.values["duration"]).value;
-                    // if(i1 == 73 && i2 == 102) std::cout << route_time/60.0 << std::endl;
-
-                    // Warn users if extract does not contain the default coordinates from above
-                    //*
-                    if (route_distance == 0 || route_time == 0) {
-                        if (static_cast<int>(coordinates1[i1][0] * 100) == static_cast<int>(coordinates2[i2][0] * 100) && static_cast<int>(coordinates1[i1][1] * 100) == static_cast<int>(coordinates2[i2][1] * 100)) {
-                            result_distance = haversineDistance * 1.5;
-                            result_time = result_distance / 14.0;
-                            // if(i1 == 73 && i2 == 102) std::cout << result_time / 60.0 << std::endl;
-                        }
-                        else {
-                            std::cout << "Note: distance or duration is zero. " << std::flush;
-                            std::cout << "You are probably doing a query outside of the OSM extract.\n"
-                                      << std::endl;
-                            std::cout << "Coord. 1: " << coordinates1[i1][1] << ", " << coordinates1[i1][0] << std::endl;
-                            std::cout << "Coord. 2: " << coordinates2[i2][1] << ", " << coordinates2[i2][0] << std::endl;
-
-                            result_distance = haversineDistance * 1.5;
-                            result_time = result_distance / 14.0;
-                            std::cout << " Havcersine time: " << result_time << " s " << std::endl;
-
-                            // if(i1 == 73 && i2 == 102) std::cout << result_time / 60.0 << std::endl;
-                        }
+                const bool flagged_row = !OSRM.snap_flagged.empty() && OSRM.snap_flagged[i];
+                for (int j : targets) {
+                    // Flagged locations get the outside-extract estimate without routing, like in the full matrices
+                    if (flagged_row || (!OSRM.snap_flagged.empty() && OSRM.snap_flagged[j])) {
+                        const int distance = static_cast<int>(static_cast<int>(haversine(from[1], from[0], coordinates[j][1], coordinates[j][0])) * outside.detour);
+                        const int time = static_cast<int>(distance / outside.speed);
+                        if (!within_budget(time, distance)) continue;
+                        for (auto &rows_of : kept) rows_of[r].push_back({j, time, distance, ROUTE_OUTSIDE_EXTRACT});
+                        continue;
                     }
-                    else {
-                        result_distance = route_distance;
-                        result_time = route_time;
-                        // cout << result_time / 60.0 << endl;
-                        // if(i1 == 73 && i2 == 102) std::cout << result_time / 60.0 << std::endl;
+                    for (size_t d = 0; d < OSRM.datasets.size(); ++d) {
+                        int distance = 0, time = 0;
+                        const uint8_t status = OSRM.datasets[d]->engine_for(node).route(params, from, coordinates[j], log, distance, time);
+                        ++block_routed;
+                        if (within_budget(time, distance)) kept[d][r].push_back({j, time, distance, status});
                     }
-                    //*/
+                }
+            }
+            candidates += block_candidates;
+            routed += block_routed;
+            progress.complete(b * SPARSE_BLOCK_ROWS, last);
+        }
+    };
 
-                    // cout << "Distance: " << result_distance << " meter\n";
-                    // cout << "Duration: " << result_time << " seconds\n";
+    const auto start = std::chrono::steady_clock::now();
+    run_route_workers(OSRM, sparse_proc, route_clock);
+    log.flush(route_status_name);
+    const double route_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << " - Osrm calculations done." << std::endl;
+
+    const int64_t pairs = static_cast<int64_t>(rows) * (n - 1);
+    std::cout << " - Sparse: " << candidates << " of " << pairs << " pairs within the straight line radius of " << std::fixed
+              << std::setprecision(0) << radius << " m (" << std::setprecision(1) << (pairs > 0 ? 100.0 * (pairs - candidates) / pairs : 0.0)
+              << "% pruned), " << routed << " routes" << std::defaultfloat << std::endl;
+    for (size_t d = 0; d < OSRM.datasets.size(); ++d) {
+        int64_t count = 0;
+        for (const auto &cells : kept[d]) count += cells.size();
+        std::cout << " - " << OSRM.datasets[d]->name << ": " << count << " pairs within the budget" << std::endl;
+    }
+
+    writers.join();
+    const double total_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    report_pipeline("routing", route_seconds, total_seconds, routed, OSRM.max_threads, route_clock, write_clock, num_files);
+}
+
+// Per-row statistics of the reductions, over the routed cells of the row (the diagonal left out)
+struct row_stats {
+    int count = 0;
+    int time_min = 0, time_p50 = 0, time_p90 = 0, time_max = 0;
+    int distance_min = 0, distance_max = 0;
+    double time_mean = 0, distance_mean = 0;
+};
+
+// Write one CSV line per row once `wait` says it is complete: `format(row, line)` appends the row's lines
+inline void write_row_csv(const std::string &filename, int rows, const row_wait_fn &wait, const std::function<void(int, std::string &)> &format,
+                          output_jobs &jobs, const std::string &label) {
+    jobs.emplace_back([filename, rows, wait, format, label]() {
+        std::ofstream out;
+        if (!open_output(filename, out)) return;
+        std::string line;
+        for (int i = 0; i < rows; ++i) {
+            if (wait) wait(i);
+            line.clear();
+            format(i, line);
+            out << line;
+        }
+        std::cout << " - " + label + " written to: " + filename + "\n" << std::flush;
+    });
+}
+
+// Streaming reductions of the rows [first_row, first_row + rows): every worker routes a whole row (the locations
+// to OSRM.destinations, or to all locations) into its own buffers and folds it into the requested per-row
+// results right away, so no matrix is stored and memory stays O(rows + threads x destinations).
+//   nearest   : the OSRM.reduce_nearest destinations with the shortest time, nearest.csv "from,rank,to,time,distance,status"
+//   stats     : row_stats.csv "from,count,time_min,time_mean,time_p50,time_p90,time_max,distance_min,distance_mean,distance_max"
+//   histogram : row_histograms.csv "from,count_0,...", bins of OSRM.reduce_histogram_width seconds, the last one open ended
+// Fallback estimates take part like routed cells, nearest.csv gives their status.
+inline void compute_reductions(osrm_params& OSRM, double **coordinates, int first_row, int rows) {
+    const bool own_locations = OSRM.destinations.empty();
+    const int cols = own_locations ? OSRM.Number_of_locations : static_cast<int>(OSRM.destinations.size());
+    std::vector<double> destination_coordinates;
+    for (const auto &destination : OSRM.destinations) {
+        destination_coordinates.push_back(destination.first);
+        destination_coordinates.push_back(destination.second);
+    }
+    auto destination = [&](int j) -> const double * { return own_locations ? coordinates[j] : destination_coordinates.data() + 2 * j; };
+    auto flagged = [&](int i) { return !OSRM.snap_flagged.empty() && OSRM.snap_flagged[i]; };
+
+    const size_t num_datasets = OSRM.datasets.size();
+    const int k = std::min(OSRM.reduce_nearest, cols);
+    const int bins = OSRM.reduce_histogram_bins;
+    std::vector<std::vector<sparse_cell>> nearest(num_datasets, std::vector<sparse_cell>(static_cast<size_t>(rows) * k));
+    std::vector<std::vector<int>> nearest_count(num_datasets, std::vector<int>(rows, 0));
+    std::vector<std::vector<row_stats>> stats(num_datasets, std::vector<row_stats>(OSRM.reduce_stats ? rows : 0));
+    std::vector<std::vector<int>> histograms(num_datasets, std::vector<int>(static_cast<size_t>(rows) * bins, 0));
+
+    // Writers stream the folded rows behind the routing workers
+    stage_clock route_clock, write_clock;
+    row_progress progress(rows, &write_clock);
+    const row_wait_fn wait = progress.waiter();
+    output_jobs jobs;
+    for (size_t d = 0; d < num_datasets; ++d) {
+        const auto &dataset = *OSRM.datasets[d];
+        if (k > 0) {
+            write_row_csv(OSRM.output_path(dataset, "nearest.csv"), rows, wait, [&, d](int i, std::string &line) {
+                for (int r = 0; r < nearest_count[d][i]; ++r) {
+                    const sparse_cell &cell = nearest[d][static_cast<size_t>(i) * k + r];
+                    line += std::to_string(first_row + i) + ',' + std::to_string(r + 1) + ',' + std::to_string(cell.to) + ',' + std::to_string(cell.time) + ',' +
+                            std::to_string(cell.distance) + ',' + static_cast<char>('0' + cell.status) + '\n';
                 }
-                else if (status == osrm::Status::Error) {
-                    const auto &code = std::get<osrm::json::String>(json_result.values.at("code")).value;
-                    const auto &message = std::get<osrm::json::String>(json_result.values.at("message")).value;
-
-                    std::cout << "Code: " << code << std::endl;
-                    std::cout << "Message: " << message << std::endl;
-                    result_distance = haversineDistance * 2;
-                    result_time = result_distance / 12.0;
+            }, jobs, "Nearest destinations");
+        }
+        if (OSRM.reduce_stats) {
+            write_row_csv(OSRM.output_path(dataset, "row_stats.csv"), rows, wait, [&, d](int i, std::string &line) {
+                const row_stats &row = stats[d][i];
+                line += std::to_string(first_row + i) + ',' + std::to_string(row.count);
+                if (row.count > 0) {
+                    std::ostringstream values;
+                    values << std::fixed << std::setprecision(1) << ',' << row.time_min << ',' << row.time_mean << ',' << row.time_p50 << ',' << row.time_p90 << ','
+                           << row.time_max << ',' << row.distance_min << ',' << row.distance_mean << ',' << row.distance_max;
+                    line += values.str();
+                }
+                else line += ",,,,,,,,";
+                line += '\n';
+            }, jobs, "Row statistics");
+        }
+        if (bins > 0) {
+            write_row_csv(OSRM.output_path(dataset, "row_histograms.csv"), rows, wait, [&, d](int i, std::string &line) {
+                line += std::to_string(first_row + i);
+                for (int b = 0; b < bins; ++b) line += ',' + std::to_string(histograms[d][static_cast<size_t>(i) * bins + b]);
+                line += '\n';
+            }, jobs, "Row histograms");
+        }
+    }
+    const size_t num_files = jobs.size();
+    std::thread writers([&]() { run_output_jobs(jobs, OSRM.write_threads, &write_clock); });
+
+    // Rows are claimed in blocks of about ROUTE_BLOCK_PAIRS pairs
+    const int ROUTE_BLOCK_PAIRS = 16384;
+    const int block_rows = std::max(1, ROUTE_BLOCK_PAIRS / std::max(1, cols));
+    const int number_of_blocks = (rows + block_rows - 1) / block_rows;
+    std::atomic<int> next_block{0};
+    DiagnosticLog log(ROUTE_STATUS_COUNT);
+    const fallback_rule &outside = OSRM.fallback.rule(ROUTE_OUTSIDE_EXTRACT);
+
+    auto reduce_proc = [&](int node) {
+        osrm::RouteParameters params;
+        params.overview = osrm::RouteParameters::OverviewType::False;
+        std::vector<int> times(cols), distances(cols), order(cols), best(cols);
+        std::vector<uint8_t> status(cols);
+        for (int b = next_block++; b < number_of_blocks; b = next_block++) {
+            const int last = std::min(rows, (b + 1) * block_rows);
+            for (int r = b * block_rows; r < last; ++r) {
+                const int i = first_row + r;
+                const double *from = coordinates[i];
+                for (size_t d = 0; d < num_datasets; ++d) {
+                    // Route the row, the diagonal of the locations to themselves is left out
+                    int count = 0;
+                    for (int j = 0; j < cols; ++j) {
+                        if (own_locations && j == i) continue;
+                        const double *to = destination(j);
+                        int distance = 0, time = 0;
+                        uint8_t route_status;
+                        if (flagged(i) || (own_locations && flagged(j))) {
+                            // Unsnappable locations get the outside-extract estimate without routing
+                            distance = static_cast<int>(static_cast<int>(haversine(from[1], from[0], to[1], to[0])) * outside.detour);
+                            time = static_cast<int>(distance / outside.speed);
+                            route_status = ROUTE_OUTSIDE_EXTRACT;
+                        }
+                        else route_status = OSRM.datasets[d]->engine_for(node).route(params, from, to, log, distance, time);
+                        times[count] = time;
+                        distances[count] = distance;
+                        status[count] = route_status;
+                        order[count] = j;
+                        ++count;
+                    }
+
+                    // Fold the row into the reductions
+                    if (k > 0) {
+                        for (int c = 0; c < count; ++c) best[c] = c;
+                        const int kept = std::min(k, count);
+                        std::partial_sort(best.begin(), best.begin() + kept, best.begin() + count, [&](int a, int b) {
+                            return times[a] != times[b] ? times[a] < times[b] : order[a] < order[b];
+                        });
+                        for (int c = 0; c < kept; ++c) {
+                            nearest[d][static_cast<size_t>(r) * k + c] = {order[best[c]], times[best[c]], distances[best[c]], status[best[c]]};
+                        }
+                        nearest_count[d][r] = kept;
+                    }
+                    if (bins > 0) {
+                        int *histogram = histograms[d].data() + static_cast<size_t>(r) * bins;
+                        for (int c = 0; c < count; ++c) ++histogram[std::min(bins - 1, static_cast<int>(times[c] / OSRM.reduce_histogram_width))];
+                    }
+                    if (OSRM.reduce_stats && count > 0) {
+                        row_stats &row = stats[d][r];
+                        row.count = count;
+                        double time_sum = 0, distance_sum = 0;
+                        for (int c = 0; c < count; ++c) {
+                            time_sum += times[c];
+                            distance_sum += distances[c];
+                        }
+                        row.time_mean = time_sum / count;
+                        row.distance_mean = distance_sum / count;
+                        row.distance_min = *std::min_element(distances.begin(), distances.begin() + count);
+                        row.distance_max = *std::max_element(distances.begin(), distances.begin() + count);
+                        // Percentiles reorder the times, they are taken last
+                        auto percentile = [&](int q) {
+                            auto it = times.begin() + std::min(count - 1, count * q / 100);
+                            std::nth_element(times.begin(), it, times.begin() + count);
+                            return *it;
+                        };
+                        row.time_min = *std::min_element(times.begin(), times.begin() + count);
+                        row.time_max = *std::max_element(times.begin(), times.begin() + count);
+                        row.time_p50 = percentile(50);
+                        row.time_p90 = percentile(90);
+                    }
                 }
-                // else if(i1 == 73 && i2 == 102) std::cout << " What ?" << std::endl;
             }
+            progress.complete(b * block_rows, last);
         }
     };
 
-    // Execute OSRM calculations in parallel
-    run_parallel(osrm_proc);
+    const auto start = std::chrono::steady_clock::now();
+    run_route_workers(OSRM, reduce_proc, route_clock);
+    log.flush(route_status_name);
+    const double route_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const int64_t pairs = static_cast<int64_t>(rows) * (own_locations ? cols - 1 : cols);
+    std::cout << " - Osrm calculations done: " << pairs << " pairs reduced to " << num_files << " per-row output(s)." << std::endl;
 
-    // cout << "Number of calls " << c_times << endl;
+    writers.join();
+    const double total_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    report_pipeline("routing", route_seconds, total_seconds, pairs * static_cast<int64_t>(OSRM.datasets.size()), OSRM.max_threads, route_clock, write_clock, num_files);
 }
 
-// Write matrices to CSV files
-inline void write_matrix_csv(osrm_params& OSRM) {
-    auto matrix_csv = [](const std::string &filename, int **matrix, int n) -> bool {
-        try {
-            std::filesystem::path p(filename);
-            auto dir = p.parent_path();
-            if (!dir.empty() && !std::filesystem::exists(dir)) {
-                std::filesystem::create_directories(dir);
+// Cluster approximation (see ClusterMatrix.h): cluster the locations into OSRM.approximate_clusters cells, route
+// the centroid matrix and the access legs of every location on each dataset and write the cluster model.
+// OSRM.approximate_audit_samples random pairs are routed exactly to report the error of the composed entries.
+inline void compute_approximate(osrm_params& OSRM, double **coordinates) {
+    const int n = OSRM.Number_of_locations;
+    const auto start = std::chrono::steady_clock::now();
+    const location_clusters clusters = cluster_locations(coordinates, n, OSRM.approximate_clusters);
+    const int k = static_cast<int>(clusters.centroid.size());
+
+    double radius = 0;
+    for (int i = 0; i < n; ++i) {
+        const double *centroid = coordinates[clusters.centroid[clusters.cluster[i]]];
+        radius = std::max(radius, haversine(coordinates[i][1], coordinates[i][0], centroid[1], centroid[0]));
+    }
+    const double exact_routes = static_cast<double>(n) * (n - 1);
+    const double routes = static_cast<double>(k) * (k - 1) + 2.0 * (n - k);
+    std::cout << " - Approximation: " << n << " locations in " << k << " clusters (largest distance to a centroid " << static_cast<int>(radius)
+              << " m), " << std::setprecision(0) << std::fixed << routes << " routes instead of " << exact_routes << " ("
+              << std::setprecision(1) << (routes > 0 ? exact_routes / routes : 0.0) << "x fewer)" << std::defaultfloat << std::endl;
+
+    std::vector<ClusterMatrix> models(OSRM.datasets.size());
+    std::vector<double> centroid_coordinates(2 * static_cast<size_t>(k));
+    for (int c = 0; c < k; ++c) {
+        centroid_coordinates[2 * c] = coordinates[clusters.centroid[c]][0];
+        centroid_coordinates[2 * c + 1] = coordinates[clusters.centroid[c]][1];
+    }
+    for (size_t d = 0; d < OSRM.datasets.size(); ++d) {
+        ClusterMatrix &model = models[d];
+        model.clusters = clusters;
+        model.centroid_time.assign(static_cast<size_t>(k) * k, 0);
+        model.centroid_distance.assign(static_cast<size_t>(k) * k, 0);
+        model.out_time.assign(n, 0);
+        model.out_distance.assign(n, 0);
+        model.in_time.assign(n, 0);
+        model.in_distance.assign(n, 0);
+        OSRM.datasets[d]->engine->compute(centroid_coordinates.data(), k, centroid_coordinates.data(), k, model.centroid_time.data(),
+                                          model.centroid_distance.data(), nullptr, OSRM.max_threads);
+    }
+
+    // Access legs, centroids have none. Workers claim blocks of locations.
+    const int LEG_BLOCK = 256;
+    std::atomic<int> next_block{0};
+    DiagnosticLog log(ROUTE_STATUS_COUNT);
+    stage_clock route_clock;
+    run_route_workers(OSRM, [&](int node) {
+        osrm::RouteParameters params;
+        params.overview = osrm::RouteParameters::OverviewType::False;
+        for (int first = LEG_BLOCK * next_block++; first < n; first = LEG_BLOCK * next_block++) {
+            for (int i = first; i < std::min(n, first + LEG_BLOCK); ++i) {
+                const int centroid = clusters.centroid[clusters.cluster[i]];
+                if (centroid == i) continue;
+                for (size_t d = 0; d < OSRM.datasets.size(); ++d) {
+                    const MatrixEngine &engine = OSRM.datasets[d]->engine_for(node);
+                    int distance = 0, time = 0;
+                    engine.route(params, coordinates[i], coordinates[centroid], log, distance, time);
+                    models[d].out_time[i] = time;
+                    models[d].out_distance[i] = distance;
+                    engine.route(params, coordinates[centroid], coordinates[i], log, distance, time);
+                    models[d].in_time[i] = time;
+                    models[d].in_distance[i] = distance;
+                }
             }
         }
-        catch (const std::exception &e) {
-            std::cerr << "Failed to create output directory for: " << filename << " -> " << e.what() << std::endl;
-            return false;
+    }, route_clock);
+    log.flush(route_status_name);
+    std::cout << " - Osrm calculations done in " << std::fixed << std::setprecision(1)
+              << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s." << std::defaultfloat << std::endl;
+
+    output_jobs jobs;
+    for (size_t d = 0; d < OSRM.datasets.size(); ++d) {
+        const std::string dir = std::filesystem::path(OSRM.output_path(*OSRM.datasets[d], "cluster_locations.csv")).parent_path().string();
+        const ClusterMatrix &model = models[d];
+        jobs.emplace_back([dir, &model]() {
+            if (model.write(dir)) std::cout << " - Cluster model written to: " + dir + "/cluster_*.csv\n" << std::flush;
+            else std::cerr << " - Failed to write the cluster model." << std::endl;
+        });
+    }
+    run_output_jobs(jobs, OSRM.write_threads);
+
+    // Error of the composed entries against exact routes of random pairs
+    const int samples = n > 1 ? OSRM.approximate_audit_samples : 0;
+    if (samples <= 0) return;
+    std::mt19937_64 rng(OSRM.seed);
+    std::uniform_int_distribution<int> pick(0, n - 1);
+    std::vector<std::pair<int, int>> pairs;
+    while (static_cast<int>(pairs.size()) < samples) {
+        const int i = pick(rng), j = pick(rng);
+        if (i != j) pairs.emplace_back(i, j);
+    }
+    for (size_t d = 0; d < OSRM.datasets.size(); ++d) {
+        std::vector<double> time_errors(pairs.size()), distance_errors(pairs.size());
+        std::atomic<size_t> next{0};
+        stage_clock audit_clock;
+        run_route_workers(OSRM, [&](int node) {
+            osrm::RouteParameters params;
+            params.overview = osrm::RouteParameters::OverviewType::False;
+            for (size_t p = next++; p < pairs.size(); p = next++) {
+                const int i = pairs[p].first, j = pairs[p].second;
+                int distance = 0, time = 0;
+                OSRM.datasets[d]->engine_for(node).route(params, coordinates[i], coordinates[j], log, distance, time);
+                time_errors[p] = std::abs(models[d].time(i, j) - time) / std::max(1.0, static_cast<double>(time));
+                distance_errors[p] = std::abs(models[d].distance(i, j) - distance) / std::max(1.0, static_cast<double>(distance));
+            }
+        }, audit_clock);
+        std::cout << " - Approximation audit " << OSRM.datasets[d]->name << " (" << pairs.size() << " pairs): time error "
+                  << error_summary(time_errors) << "; distance error " << error_summary(distance_errors) << std::endl;
+    }
+    log.flush(route_status_name);
+}
+
+// Circuity model (see CircuityModel.h): route a stratified sample of OSRM.circuity_samples pairs on every dataset,
+// fit the model of each dataset and fill the full matrices with its estimates, streamed to the outputs like
+// routed matrices. OSRM.circuity_audit_samples random pairs outside the sample are routed as well to report the
+// error of the estimates. Returns false if a dataset has no routable sample pair.
+inline bool compute_circuity(osrm_params& OSRM, double **coordinates) {
+    const int n = OSRM.Number_of_locations;
+    const size_t num_datasets = OSRM.datasets.size();
+    const auto start = std::chrono::steady_clock::now();
+    const CircuityModel geometry(coordinates, n, OSRM.circuity_grid);
+    // Locations the snap pre-flight flagged are neither sampled nor estimated, they get the outside-extract fallback
+    auto flagged = [&](int i) { return !OSRM.snap_flagged.empty() && OSRM.snap_flagged[i]; };
+
+    // Stratified sample: draw random pairs into a bucket per stratum, then take the same share of every stratum
+    // (all pairs of the smaller ones), so sparse cells and long distance bands are fitted too
+    std::mt19937_64 rng(OSRM.seed);
+    std::uniform_int_distribution<int> pick(0, std::max(0, n - 1));
+    const size_t wanted = n > 1 ? OSRM.circuity_samples : 0;
+    std::vector<std::vector<std::pair<int, int>>> buckets(geometry.strata());
+    std::unordered_set<int64_t> drawn;
+    for (size_t d = 0; d < 20 * wanted; ++d) {
+        const int i = pick(rng), j = pick(rng);
+        if (i == j || flagged(i) || flagged(j) || !drawn.insert(static_cast<int64_t>(i) * n + j).second) continue;
+        auto &bucket = buckets[geometry.stratum(i, geometry.straight(i, j))];
+        if (bucket.size() < wanted) bucket.emplace_back(i, j);
+    }
+    std::vector<size_t> take(buckets.size(), 0);
+    size_t left = wanted;
+    while (left > 0) {
+        size_t open = 0;
+        for (size_t k = 0; k < buckets.size(); ++k) open += take[k] < buckets[k].size();
+        if (open == 0) break;
+        const size_t share = std::max<size_t>(1, left / open);
+        for (size_t k = 0; k < buckets.size() && left > 0; ++k) {
+            const size_t add = std::min({share, buckets[k].size() - take[k], left});
+            take[k] += add;
+            left -= add;
         }
+    }
+    std::vector<std::pair<int, int>> pairs;
+    std::unordered_set<int64_t> sampled;
+    for (size_t k = 0; k < buckets.size(); ++k) {
+        for (size_t p = 0; p < take[k]; ++p) {
+            pairs.push_back(buckets[k][p]);
+            sampled.insert(static_cast<int64_t>(buckets[k][p].first) * n + buckets[k][p].second);
+        }
+    }
+    const size_t num_samples = pairs.size();
+
+    // Held-out pairs: uniform like the cells of the matrix, none of them in the sample
+    const size_t audit = n > 1 ? OSRM.circuity_audit_samples : 0;
+    for (size_t tries = 0; pairs.size() - num_samples < audit && tries < 20 * audit; ++tries) {
+        const int i = pick(rng), j = pick(rng);
+        if (i != j && !flagged(i) && !flagged(j) && !sampled.count(static_cast<int64_t>(i) * n + j)) pairs.emplace_back(i, j);
+    }
 
-        std::ofstream out(filename);
-        if (!out.is_open()) {
-            std::cerr << "Failed to open output file: " << filename << std::endl;
+    // Route the sample and the held-out pairs on every dataset
+    std::vector<int> distances(pairs.size() * num_datasets), times(pairs.size() * num_datasets);
+    std::vector<uint8_t> status(pairs.size() * num_datasets);
+    std::atomic<size_t> next{0};
+    DiagnosticLog log(ROUTE_STATUS_COUNT);
+    stage_clock route_clock;
+    run_route_workers(OSRM, [&](int node) {
+        osrm::RouteParameters params;
+        params.overview = osrm::RouteParameters::OverviewType::False;
+        for (size_t p = next++; p < pairs.size(); p = next++) {
+            for (size_t d = 0; d < num_datasets; ++d) {
+                const size_t cell = p * num_datasets + d;
+                status[cell] = OSRM.datasets[d]->engine_for(node).route(params, coordinates[pairs[p].first], coordinates[pairs[p].second], log,
+                                                                        distances[cell], times[cell]);
+            }
+        }
+    }, route_clock);
+    log.flush(route_status_name);
+    std::cout << " - Circuity model: " << num_samples << " sample and " << pairs.size() - num_samples << " held-out pairs routed in " << std::fixed
+              << std::setprecision(1) << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s ("
+              << OSRM.circuity_grid << "x" << OSRM.circuity_grid << " grid, " << CIRCUITY_BANDS << " distance bands)" << std::defaultfloat << std::endl;
+
+    // Fit per dataset from the routed sample pairs, fallback estimates left out
+    std::vector<CircuityModel> models(num_datasets, geometry);
+    for (size_t d = 0; d < num_datasets; ++d) {
+        std::vector<circuity_sample> samples;
+        for (size_t p = 0; p < num_samples; ++p) {
+            const size_t cell = p * num_datasets + d;
+            if (status[cell] != ROUTE_OK) continue;
+            samples.push_back({pairs[p].first, geometry.straight(pairs[p].first, pairs[p].second), static_cast<double>(distances[cell]),
+                               static_cast<double>(times[cell])});
+        }
+        const int fitted = models[d].fit(samples);
+        if (fitted < 0) {
+            std::cerr << "No sample pair could be routed on " << OSRM.datasets[d]->name << ", the circuity model can't be fitted." << std::endl;
             return false;
         }
+        const CircuityModel &model = models[d];
+        std::cout << " - Circuity model " << OSRM.datasets[d]->name << ": " << samples.size() << " routed samples, " << fitted << " of "
+                  << model.strata() << " strata fitted (the others use their distance band), median circuity " << std::fixed << std::setprecision(2)
+                  << model.median_circuity() << ", median speed " << std::setprecision(1) << model.median_circuity() / model.median_pace() * 3.6
+                  << " km/h" << std::defaultfloat << std::endl;
 
-        for (int i = 0; i < n; ++i) {
-            for (int j = 0; j < n; ++j) {
-                out << matrix[i][j];
-                if (j + 1 < n) out << ',';
+        std::vector<double> time_errors, distance_errors;
+        for (size_t p = num_samples; p < pairs.size(); ++p) {
+            const size_t cell = p * num_datasets + d;
+            if (status[cell] != ROUTE_OK) continue;
+            int distance = 0, time = 0;
+            model.estimate(pairs[p].first, pairs[p].second, distance, time);
+            time_errors.push_back(std::abs(time - times[cell]) / std::max(1.0, static_cast<double>(times[cell])));
+            distance_errors.push_back(std::abs(distance - distances[cell]) / std::max(1.0, static_cast<double>(distances[cell])));
+        }
+        if (!time_errors.empty()) {
+            std::cout << " - Circuity audit " << OSRM.datasets[d]->name << " (" << time_errors.size() << " held-out pairs): time error "
+                      << error_summary(time_errors) << "; distance error " << error_summary(distance_errors) << std::endl;
+        }
+    }
+
+    // Fill the matrices with estimates, the writers stream every finished block of rows
+    OSRM.allocate_matrices(n);
+    prefill_flagged_locations(OSRM, coordinates, 0, n);
+    stage_clock fill_clock, write_clock;
+    row_progress progress(n, &write_clock);
+    const row_wait_fn wait = progress.waiter();
+    output_jobs jobs;
+    if (OSRM.output_csv) write_matrix_csv(OSRM, wait, jobs);
+    if (OSRM.output_binary) write_matrix_binary(OSRM, false, wait, jobs);
+    if (OSRM.output_compressed) write_matrix_binary(OSRM, true, wait, jobs);
+    if (OSRM.output_arrow) write_matrix_table(OSRM, TableFormat::Arrow, 0, wait, jobs);
+    if (OSRM.output_parquet) write_matrix_table(OSRM, TableFormat::Parquet, 0, wait, jobs);
+    const size_t num_files = jobs.size();
+    std::thread writers([&]() { run_output_jobs(jobs, OSRM.write_threads, &write_clock); });
+
+    const int FILL_BLOCK_ROWS = 64;
+    std::atomic<int> next_block{0};
+    const auto fill_start = std::chrono::steady_clock::now();
+    run_route_workers(OSRM, [&](int) {
+        for (int first = FILL_BLOCK_ROWS * next_block++; first < n; first = FILL_BLOCK_ROWS * next_block++) {
+            const int last = std::min(n, first + FILL_BLOCK_ROWS);
+            for (size_t d = 0; d < num_datasets; ++d) {
+                TravelMatrix &dataset_times = OSRM.datasets[d]->TravelTimes, &dataset_distances = OSRM.datasets[d]->TravelDistances;
+                for (int i = first; i < last; ++i) {
+                    for (int j = 0; j < n; ++j) {
+                        if (i != j && (flagged(i) || flagged(j))) continue;
+                        int distance = 0, time = 0;
+                        if (i != j) models[d].estimate(i, j, distance, time);
+                        dataset_distances.set(i, j, distance);
+                        dataset_times.set(i, j, time);
+                    }
+                }
             }
-            out << '\n';
+            progress.complete(first, last);
         }
-        out.close();
-        return true;
-    };
+    }, fill_clock);
+    const double fill_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - fill_start).count();
+    report_matrix_storage(OSRM);
+
+    writers.join();
+    const double total_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - fill_start).count();
+    report_pipeline("estimating", fill_seconds, total_seconds, static_cast<int64_t>(n) * n * num_datasets, OSRM.max_threads, fill_clock, write_clock, num_files);
+    return true;
+}
+
+// Execution strategy chosen by the budget planner
+enum class run_strategy { InMemory, Sharded, Abort };
+
+// Budget planner: estimate the peak memory and the runtime of the run before any matrix is allocated and fit
+// it into OSRM.memory_limit and OSRM.deadline. The datasets, replicas and locations are loaded by now, so the
+// resident size of the process is their real footprint; the runtime comes from a calibration sample of
+// routes. Over the memory limit the matrices first get a smaller encoding (24 bits is exact for any real
+// extract, 16 bits quantises to the unit that covers the estimated range) unless the user chose one, then the
+// rows are split into shards that fit (tile size). Runs estimated to miss the deadline are aborted.
+inline run_strategy plan_run(osrm_params& OSRM, double **coordinates) {
+    const int n = OSRM.Number_of_locations;
+    const size_t num_datasets = OSRM.datasets.size();
+    const double base = static_cast<double>(current_rss_bytes());
+    std::cout << " - Plan: datasets and " << n << " locations use " << format_bytes(base) << " resident" << std::endl;
 
-    const std::string dist_file = "/app/results/travel_distances.csv";
-    const std::string time_file = "/app/results/travel_times.csv";
+    // Calibration: routes per second of all workers on the first dataset
+    const int PLAN_CALIBRATION_PAIRS = 2000;
+    const int calibration = static_cast<int>(std::min<int64_t>(PLAN_CALIBRATION_PAIRS, static_cast<int64_t>(n) * (n - 1)));
+    const double throughput = calibration > 0 ? route_throughput(OSRM, coordinates, benchmark_pairs(OSRM, calibration), OSRM.max_threads, 0) : 0;
 
-    if (matrix_csv(dist_file, OSRM.TravelDistances, OSRM.Number_of_locations)) {
-        std::cout << " - Travel distances written to: " << dist_file << std::endl;
+    // Routes of the mode, per dataset
+    const bool matrices = OSRM.approximate_clusters == 0 && !OSRM.reduction() && !OSRM.sparse();
+    double routes = static_cast<double>(n) * (n - 1);
+    if (OSRM.approximate_clusters > 0) {
+        const double k = std::min(OSRM.approximate_clusters, n);
+        routes = k * (k - 1) + 2 * (n - k) + OSRM.approximate_audit_samples;
     }
-    else {
-        std::cerr << " - Failed to write travel distances to CSV." << std::endl;
+    else if (OSRM.circuity_samples > 0) routes = static_cast<double>(OSRM.circuity_samples) + OSRM.circuity_audit_samples;
+    else if (OSRM.reduction() && !OSRM.destinations.empty()) routes = static_cast<double>(n) * OSRM.destinations.size();
+    else if (matrices && OSRM.symmetric) routes /= 2;
+    routes *= num_datasets;
+    const double seconds = throughput > 0 ? routes / throughput : 0;
+
+    run_strategy strategy = run_strategy::InMemory;
+    std::ostringstream decision;
+    if (matrices) {
+        // Cells: times and distances in the encoding plus one status byte, per dataset
+        auto matrix_bytes = [&](int bits, int rows) {
+            const double cells = OSRM.symmetric && rows == n ? static_cast<double>(n) * (n + 1) / 2 : static_cast<double>(rows) * n;
+            return cells * (2 * bits / 8 + 1) * num_datasets;
+        };
+        const double buffers = (OSRM.output_arrow + OSRM.output_parquet) * num_datasets * TABLE_FILE_BATCH_CELLS * 14.0;
+        const double limit = static_cast<double>(OSRM.memory_limit);
+        int bits = OSRM.time_encoding.bits;
+
+        if (limit > 0 && base + buffers + matrix_bytes(bits, n) > limit) {
+            // Largest values to expect: twice the straight line extent of the locations, at no less than 5 m/s
+            double min_lon = coordinates[0][0], max_lon = min_lon, min_lat = coordinates[0][1], max_lat = min_lat;
+            for (int i = 1; i < n; ++i) {
+                min_lon = std::min(min_lon, coordinates[i][0]);
+                max_lon = std::max(max_lon, coordinates[i][0]);
+                min_lat = std::min(min_lat, coordinates[i][1]);
+                max_lat = std::max(max_lat, coordinates[i][1]);
+            }
+            const double max_distance = 2 * haversine(min_lat, min_lon, max_lat, max_lon);
+            const double max_time = max_distance / 5;
+            auto set_encoding = [&](int b) {
+                const double codes = b == 32 ? INT32_MAX - 1.0 : (1u << b) - 2.0;
+                OSRM.time_encoding = {b, round_unit(max_time, codes)};
+                OSRM.distance_encoding = {b, round_unit(max_distance, codes)};
+                bits = b;
+            };
+
+            bool fits = false;
+            if (!OSRM.encoding_explicit) {
+                for (int b : {24, 16}) {
+                    if (b < bits && base + buffers + matrix_bytes(b, n) <= limit) {
+                        set_encoding(b);
+                        fits = true;
+                        break;
+                    }
+                }
+            }
+            if (!fits) {
+                // Tiles of rows that fit next to the datasets, in the smallest exact encoding
+                if (!OSRM.encoding_explicit && bits > 24) set_encoding(24);
+                const int rows = static_cast<int>(std::min<double>(n, (limit - base - buffers) / matrix_bytes(bits, 1)));
+                if (rows < 1) {
+                    std::cerr << "The datasets alone need " << format_bytes(base) << ", not enough for any matrix row within --memory-limit "
+                              << format_bytes(limit) << "." << std::endl;
+                    return run_strategy::Abort;
+                }
+                if (!OSRM.shardable()) {
+                    std::cerr << "The matrices need " << format_bytes(matrix_bytes(bits, n)) << ", more than --memory-limit allows, and these options "
+                              << "can't run sharded (sharded runs support " << osrm_params::shardable_options() << ")." << std::endl;
+                    return run_strategy::Abort;
+                }
+                OSRM.shards = (n + rows - 1) / rows;
+                OSRM.shard_workers = 1;
+                strategy = run_strategy::Sharded;
+                if (!OSRM.encoding_explicit) {
+                    std::ostringstream time_unit, distance_unit;
+                    time_unit << OSRM.time_encoding.unit;
+                    distance_unit << OSRM.distance_encoding.unit;
+                    OSRM.shard_job_args.insert(OSRM.shard_job_args.end(), {"--matrix-bits", std::to_string(bits), "--time-unit", time_unit.str(),
+                                                                           "--distance-unit", distance_unit.str()});
+                }
+            }
+        }
+
+        const double peak = base + buffers + matrix_bytes(bits, strategy == run_strategy::Sharded ? (n + OSRM.shards - 1) / OSRM.shards : n);
+        decision << (strategy == run_strategy::Sharded ? "sharded, " + std::to_string(OSRM.shards) + " shards of up to " +
+                                                             std::to_string((n + OSRM.shards - 1) / OSRM.shards) + " rows"
+                                                       : std::string("in memory"))
+                 << ", " << bits << " bit cells (time unit " << OSRM.time_encoding.unit << " s, distance unit " << OSRM.distance_encoding.unit
+                 << " m), peak about " << format_bytes(peak);
+        if (limit > 0) decision << " of " << format_bytes(limit);
     }
+    else decision << "streaming, the results are O(locations), peak about " << format_bytes(base);
+    std::cout << " - Plan: " << decision.str() << std::endl;
+    std::cout << " - Plan: " << calibration << " calibration routes at " << std::fixed << std::setprecision(0) << throughput << " routes/s ("
+              << OSRM.max_threads << " threads), " << (OSRM.sparse() ? "at most " : "") << routes << " routes, about "
+              << format_duration(seconds) << std::defaultfloat << std::endl;
 
-    if (matrix_csv(time_file, OSRM.TravelTimes, OSRM.Number_of_locations)) {
-        std::cout << " - Travel times written to: " << time_file << std::endl;
+    if (OSRM.deadline > 0 && seconds > OSRM.deadline) {
+        std::cerr << "The run would take about " << format_duration(seconds) << ", more than --deadline " << format_duration(OSRM.deadline) << ".";
+        // Clusters whose model routes fit the deadline: K^2 + 2N routes per dataset
+        const double budget = OSRM.deadline * throughput / num_datasets - 2.0 * n;
+        if (matrices && budget > 1) std::cerr << " --approximate " << static_cast<int64_t>(std::sqrt(budget)) << " or more threads would fit.";
+        std::cerr << std::endl;
+        return run_strategy::Abort;
     }
-    else {
-        std::cerr << " - Failed to write travel times to CSV." << std::endl;
+    return strategy;
+}
+
+// Write a row-major n x n matrix of one job to a CSV file
+template <typename T>
+inline bool write_job_csv(const std::string &filename, const std::vector<T> &values, int n) {
+    std::ofstream out;
+    if (!open_output(filename, out)) return false;
+    std::string line;
+    for (int i = 0; i < n; ++i) {
+        line.clear();
+        for (int j = 0; j < n; ++j) {
+            if (j) line += ',';
+            line += std::to_string(static_cast<int>(values[static_cast<size_t>(i) * n + j]));
+        }
+        line += '\n';
+        out << line;
     }
+    return out.good();
+}
+
+// Batch jobs of OSRM.manifest_path (see Manifest.h) against the datasets loaded once. The jobs are small, so
+// every routing worker takes whole jobs, largest (by coordinates file size) first so the last ones to finish
+// are short, routes them on one thread and writes them before taking the next one. A job that fails (bad
+// coordinates, unwritable directory) is reported and the others go on; the run then exits with a failure.
+inline void run_manifest(osrm_params& OSRM) {
+    std::vector<manifest_job> jobs;
+    if (!load_manifest(OSRM.manifest_path, jobs)) exit(EXIT_FAILURE);
+
+    std::vector<std::pair<uintmax_t, int>> by_size(jobs.size());
+    for (size_t k = 0; k < jobs.size(); ++k) {
+        std::error_code ec;
+        const uintmax_t size = std::filesystem::file_size(jobs[k].coordinates_path, ec);
+        by_size[k] = {ec ? 0 : size, static_cast<int>(k)};
+    }
+    std::sort(by_size.begin(), by_size.end(), [](const auto &a, const auto &b) { return a.first > b.first; });
+
+    std::cout << " - Manifest: " << jobs.size() << " jobs on " << OSRM.max_threads << " workers" << std::endl;
+    std::atomic<size_t> next{0};
+    std::atomic<int> failed{0}, done{0};
+    std::atomic<int64_t> routes{0};
+    std::mutex report;
+    auto job_proc = [&](int node) {
+        for (size_t k = next++; k < by_size.size(); k = next++) {
+            const manifest_job &job = jobs[by_size[k].second];
+            const auto start = std::chrono::steady_clock::now();
+            std::vector<std::pair<double, double>> locations;
+            bool ok = load_coordinates(job.coordinates_path, locations, OSRM.coordinates_format, 1) && !locations.empty();
+            const int n = static_cast<int>(locations.size());
+            if (ok) {
+                std::vector<double> points(2 * static_cast<size_t>(n));
+                for (int i = 0; i < n; ++i) {
+                    points[2 * i] = locations[i].first;
+                    points[2 * i + 1] = locations[i].second;
+                }
+                const size_t cells = static_cast<size_t>(n) * n;
+                std::vector<int32_t> times(cells), distances(cells);
+                std::vector<uint8_t> status(cells);
+                for (const auto &dataset : OSRM.datasets) {
+                    const std::string dir = OSRM.datasets.size() <= 1 ? job.output_dir : job.output_dir + "/" + dataset->name;
+                    ok = ok && dataset->engine_for(node).compute(points.data(), n, points.data(), n, times.data(), distances.data(), status.data(), 1);
+                    // Going to the same place gives zero, like in a normal run
+                    for (int i = 0; i < n; ++i) {
+                        times[static_cast<size_t>(i) * n + i] = 0;
+                        distances[static_cast<size_t>(i) * n + i] = 0;
+                        status[static_cast<size_t>(i) * n + i] = ROUTE_OK;
+                    }
+                    std::error_code ec;
+                    std::filesystem::create_directories(dir, ec);
+                    ok = ok && write_job_csv(dir + "/travel_distances.csv", distances, n) && write_job_csv(dir + "/travel_times.csv", times, n);
+                    if (OSRM.output_status) ok = ok && write_job_csv(dir + "/route_status.csv", status, n);
+                }
+                routes += static_cast<int64_t>(n) * n * OSRM.datasets.size();
+            }
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::lock_guard<std::mutex> lock(report);
+            if (ok) {
+                std::cout << " - Job " << ++done << "/" << jobs.size() << ": " << job.coordinates_path << " -> " << job.output_dir << " (" << n
+                          << " locations, " << std::fixed << std::setprecision(2) << seconds << " s)" << std::defaultfloat << std::endl;
+            }
+            else {
+                ++failed;
+                std::cerr << "Job " << job.coordinates_path << " -> " << job.output_dir << " failed." << std::endl;
+            }
+        }
+    };
+
+    const auto start = std::chrono::steady_clock::now();
+    stage_clock clock;
+    run_route_workers(OSRM, job_proc, clock);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << std::fixed << std::setprecision(1) << " - Manifest: " << done << " jobs done, " << failed << " failed, " << routes << " routes in "
+              << seconds << " s (workers busy " << clock.busy_share() * 100 << "%)" << std::defaultfloat << std::endl;
+    if (failed > 0) exit(EXIT_FAILURE);
+}
+
+// Shard worker: claim row shards of the sharded run in OSRM.shard_worker_dir until none are left.
+// The engines are loaded once and reused for every shard, the snap flags come from the coordinator.
+// A shard that can't be computed is marked failed, so the coordinator stops instead of waiting for it.
+// Returns false if any shard failed.
+inline bool run_shard_worker(osrm_params& OSRM, double **coordinates) {
+    if (!read_shard_flags(OSRM.shard_worker_dir, OSRM.Number_of_locations, OSRM.snap_flagged)) return false;
+    shard_spec spec;
+    std::string claim;
+    int completed = 0, failed = 0;
+    while (claim_shard(OSRM.shard_worker_dir, spec, claim)) {
+        std::cout << " - Shard " << spec.index << ": rows " << spec.first_row << " to " << spec.first_row + spec.rows - 1 << std::endl;
+        if (spec.first_row < 0 || spec.rows < 0 || spec.first_row + spec.rows > OSRM.Number_of_locations) {
+            const std::string reason = "rows outside the " + std::to_string(OSRM.Number_of_locations) + " locations of the job";
+            std::cerr << "Shard " << spec.index << ": " << reason << "." << std::endl;
+            fail_shard(OSRM.shard_worker_dir, spec.index, claim, reason);
+            ++failed;
+            continue;
+        }
+        OSRM.output_dir = shard_output_dir(OSRM.shard_worker_dir, spec.index);
+        if (OSRM.reduction()) compute_reductions(OSRM, coordinates, spec.first_row, spec.rows);
+        else if (OSRM.sparse()) compute_sparse(OSRM, coordinates, spec.first_row, spec.rows);
+        else compute_matrices(OSRM, coordinates, spec.first_row, spec.rows);
+        if (!finish_shard(OSRM.shard_worker_dir, spec, claim)) {
+            std::cerr << "Failed to mark shard " << spec.index << " as done." << std::endl;
+            fail_shard(OSRM.shard_worker_dir, spec.index, claim, "the outputs could not be marked done");
+            ++failed;
+            continue;
+        }
+        ++completed;
+    }
+    std::cout << " - No shards left, this worker completed " << completed << " shard(s), " << failed << " failed." << std::endl;
+    return failed == 0;
+}
+
+// Shard coordinator: split the rows into OSRM.shards shards in OSRM.shard_dir, start the local workers,
+// wait until every shard is done (by local or external workers) and merge the shard outputs. The locations
+// must be prepared and snapped (if requested); the workers get the snap flags with the job. The run stops
+// with an error as soon as a worker marks a shard failed.
+inline void run_shard_coordinator(osrm_params& OSRM) {
+    const std::vector<std::pair<double, double>> locations(OSRM.coordinates.begin(), OSRM.coordinates.begin() + OSRM.Number_of_locations);
+    if (!write_shard_job(OSRM.shard_dir, OSRM.shard_job_args, locations, OSRM.snap_flagged, OSRM.shards)) exit(EXIT_FAILURE);
+    std::cout << "Sharded run: " << OSRM.Number_of_locations << " locations in " << OSRM.shards << " row shards, job in " << OSRM.shard_dir << std::endl;
+
+    // Local workers share the CPUs of this host
+    std::vector<pid_t> workers;
+    const int worker_threads = std::max(1, OSRM.max_threads / std::max(1, OSRM.shard_workers));
+    for (int w = 0; w < OSRM.shard_workers; ++w) {
+        pid_t pid;
+        if (spawn_process(OSRM.executable, {"--shard-worker", OSRM.shard_dir, "--threads", std::to_string(worker_threads)}, pid)) workers.push_back(pid);
+    }
+    std::cout << " - Started " << workers.size() << " local worker(s) with " << worker_threads << " threads each";
+    std::cout << (OSRM.shard_workers == 0 ? ", waiting for external workers (osrm --shard-worker " + OSRM.shard_dir + ")" : "") << std::endl;
+
+    int done = 0, reported = -1;
+    while ((done = count_done_shards(OSRM.shard_dir, OSRM.shards)) < OSRM.shards) {
+        if (done != reported) {
+            std::cout << " - " << done << "/" << OSRM.shards << " shards done" << std::endl;
+            reported = done;
+        }
+        const auto failed = failed_shards(OSRM.shard_dir, OSRM.shards);
+        if (!failed.empty()) {
+            for (const auto &shard : failed) std::cerr << "Shard " << shard.first << " failed: " << shard.second << std::endl;
+            std::cerr << "Sharded run aborted, see " << OSRM.shard_dir << "." << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        // Reap exited local workers; without any worker left (and none external) the run can't finish
+        for (auto it = workers.begin(); it != workers.end();) {
+            int status = 0;
+            if (waitpid(*it, &status, WNOHANG) == *it) {
+                if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) std::cerr << "Shard worker " << *it << " failed." << std::endl;
+                it = workers.erase(it);
+            }
+            else ++it;
+        }
+        if (OSRM.shard_workers > 0 && workers.empty() && count_done_shards(OSRM.shard_dir, OSRM.shards) < OSRM.shards) {
+            std::cerr << "All local shard workers exited with shards left, see " << OSRM.shard_dir << "." << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    for (pid_t pid : workers) waitpid(pid, nullptr, 0);
+    std::cout << " - " << OSRM.shards << "/" << OSRM.shards << " shards done" << std::endl;
+
+    if (!merge_shard_outputs(OSRM.shard_dir, OSRM.shards, OSRM.output_dir)) exit(EXIT_FAILURE);
 }
 
-// Calculate travel times and distances
 void calculate_osrm_metrics(osrm_params& OSRM) {
-    
-    // Start the engine once
+
+    // A coordinator doesn't route, it only needs the locations. It snaps them once for all workers.
+    if (OSRM.shards > 0) {
+        if (OSRM.max_snap_distance > 0) {
+            // Loads the locations along with the engines, which are only needed for the snapping
+            OSRM.start_engine();
+            snap_locations(OSRM);
+            for (auto &dataset : OSRM.datasets) dataset->release_engines();
+        }
+        else if (!OSRM.prepare_locations()) exit(EXIT_FAILURE);
+        run_shard_coordinator(OSRM);
+        return;
+    }
+
+    // Start the engines once
     OSRM.start_engine();
 
-    std::cout << "OSRM calculations started ...\n - Number of threads being used: " << OSRM.max_threads << std::endl;
+    std::cout << "OSRM calculations started ...\n - Number of threads being used: " << OSRM.max_threads << " routing, "
+              << OSRM.write_threads << " writing" << std::endl;
+    std::cout << " - Datasets:";
+    for (const auto &dataset : OSRM.datasets) std::cout << " " << dataset->name;
+    std::cout << std::endl;
+    if (OSRM.route_curve != curve_type::None) std::cout << " - Route order: " << curve_name(OSRM.route_curve) << " curve" << std::endl;
+
+    // Batch jobs bring their own locations
+    if (!OSRM.manifest_path.empty()) {
+        run_manifest(OSRM);
+        return;
+    }
+
+    // Snap pre-flight, may drop locations
+    if (OSRM.max_snap_distance > 0) snap_locations(OSRM);
 
     // ++++++++++++++++++++ Client locations ++++++++++++++++++++
     
@@ -272,27 +1746,41 @@ void calculate_osrm_metrics(osrm_params& OSRM) {
         coordinates[i] = new double[2];
         coordinates[i][0] = OSRM.coordinates[i].first;   // longitude
         coordinates[i][1] = OSRM.coordinates[i].second; // latitude
-        for (int j = 0; j < OSRM.Number_of_locations; j++) {
-            if (i == j) {
-                OSRM.TravelTimes[i][j] = 0;     // going to the same place gives zero
-                OSRM.TravelDistances[i][j] = 0; // going to the same place gives zero
-            }
-            else {
-                OSRM.TravelTimes[i][j] = INT32_MAX;
-                OSRM.TravelDistances[i][j] = INT32_MAX;
-            }
-        }
     }
 
-    osrmEngine(OSRM.TravelDistances, OSRM.TravelTimes, OSRM.Number_of_locations, OSRM.Number_of_locations, coordinates, coordinates, OSRM);
-    std::cout << " - Osrm calculations done." << std::endl;
-
-    // Write matrices to CSV files
-    write_matrix_csv(OSRM);
+    bool failed = false;
+    if (OSRM.numa_benchmark_pairs > 0 || OSRM.thread_benchmark_pairs > 0 || OSRM.reorder_benchmark_pairs > 0) {
+        // Benchmark only, no matrices
+        if (OSRM.thread_benchmark_pairs > 0) benchmark_thread_scaling(OSRM, coordinates, OSRM.thread_benchmark_pairs);
+        if (OSRM.numa_benchmark_pairs > 0) benchmark_numa_scaling(OSRM, coordinates, OSRM.numa_benchmark_pairs);
+        if (OSRM.reorder_benchmark_pairs > 0) benchmark_route_order(OSRM, coordinates, OSRM.reorder_benchmark_pairs);
+    }
+    else if (!OSRM.shard_worker_dir.empty()) {
+        failed = !run_shard_worker(OSRM, coordinates);
+    }
+    else {
+        const run_strategy strategy = OSRM.memory_limit > 0 || OSRM.deadline > 0 || OSRM.plan_only ? plan_run(OSRM, coordinates) : run_strategy::InMemory;
+        if (strategy == run_strategy::Abort) failed = true;
+        else if (OSRM.plan_only) std::cout << " - Plan only, nothing routed." << std::endl;
+        else if (strategy == run_strategy::Sharded) {
+            // The worker loads its own engines, free the ones of this process first
+            for (auto &dataset : OSRM.datasets) dataset->release_engines();
+            run_shard_coordinator(OSRM);
+        }
+        else {
+            if (OSRM.approximate_clusters > 0) compute_approximate(OSRM, coordinates);
+            else if (OSRM.circuity_samples > 0) failed = !compute_circuity(OSRM, coordinates);
+            else if (OSRM.reduction()) compute_reductions(OSRM, coordinates, 0, OSRM.Number_of_locations);
+            else if (OSRM.sparse()) compute_sparse(OSRM, coordinates, 0, OSRM.Number_of_locations);
+            else compute_matrices(OSRM, coordinates, 0, OSRM.Number_of_locations);
+            if (!OSRM.geometry_pairs_path.empty()) export_geometries(OSRM, coordinates);
+        }
+    }
 
     // delete raw pointers
     for (int i = 0; i < OSRM.Number_of_locations; i++) {
         delete[] coordinates[i];
     }
     delete[] coordinates;
-}
\ No newline at end of file
+    if (failed) exit(EXIT_FAILURE);
+}
@@ -0,0 +1,199 @@
+// std libs
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+
+// Jsoncpp
+#include <json/json.h>
+
+#include "Polygon.h"
+
+// ********************************* LOCAL PARAMETERS ************************************
+// Average number of edges per latitude band the index aims for
+#define EDGES_PER_BAND 4
+// Upper limit on the number of latitude bands
+#define MAX_BANDS (1 << 16)
+// Maximum average number of bands a single edge is copied into
+#define MAX_EDGE_COPIES 8
+
+// ++++++++++++++++++++++++++++++++++++++ FUNCTIONS ++++++++++++++++++++++++++++++++++++++
+
+size_t MultiPolygon::vertex_count() const {
+    size_t n = 0;
+    for (const auto &polygon : polygons) {
+        for (const auto &ring : polygon) n += ring.size();
+    }
+    return n;
+}
+
+void MultiPolygon::update_bounds() {
+    lon_min = lat_min = std::numeric_limits<double>::max();
+    lon_max = lat_max = std::numeric_limits<double>::lowest();
+    std::vector<Edge> edges;
+    for (const auto &polygon : polygons) {
+        for (const auto &ring : polygon) {
+            for (size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++) {
+                const auto &p = ring[i];
+                lon_min = std::min(lon_min, p.first);
+                lon_max = std::max(lon_max, p.first);
+                lat_min = std::min(lat_min, p.second);
+                lat_max = std::max(lat_max, p.second);
+                // Horizontal edges never cross a horizontal ray
+                if (p.second != ring[j].second) edges.push_back({p.first, p.second, ring[j].first, ring[j].second});
+            }
+        }
+    }
+
+    band_edges.clear();
+    band_offsets.clear();
+    if (edges.empty()) return;
+
+    size_t num_bands = std::clamp<size_t>(edges.size() / EDGES_PER_BAND, 1, MAX_BANDS);
+    auto band_of = [&](double lat) {
+        return std::min(num_bands - 1, static_cast<size_t>(std::max(0.0, (lat - lat_min) * band_scale)));
+    };
+
+    // Counting sort of the edges into every band their latitude range touches. Long, steep edges are
+    // copied into many bands; halve the band count until the copies stay within a bounded factor.
+    while (true) {
+        band_scale = lat_max > lat_min ? num_bands / (lat_max - lat_min) : 0.0;
+        band_offsets.assign(num_bands + 1, 0);
+        size_t entries = 0;
+        for (const auto &e : edges) {
+            size_t first = band_of(std::min(e.y1, e.y2)), last = band_of(std::max(e.y1, e.y2));
+            for (size_t b = first; b <= last; ++b) ++band_offsets[b + 1];
+            entries += last - first + 1;
+        }
+        if (entries <= MAX_EDGE_COPIES * edges.size() || num_bands == 1) break;
+        num_bands /= 2;
+    }
+    for (size_t b = 0; b < num_bands; ++b) band_offsets[b + 1] += band_offsets[b];
+
+    band_edges.resize(band_offsets.back());
+    std::vector<unsigned> fill(band_offsets.begin(), band_offsets.end() - 1);
+    for (const auto &e : edges) {
+        for (size_t b = band_of(std::min(e.y1, e.y2)), last = band_of(std::max(e.y1, e.y2)); b <= last; ++b) band_edges[fill[b]++] = e;
+    }
+}
+
+bool MultiPolygon::contains(double lon, double lat) const {
+    if (lon < lon_min || lon > lon_max || lat < lat_min || lat > lat_max) return false;
+    if (band_offsets.empty()) return contains_linear(lon, lat);
+
+    const size_t num_bands = band_offsets.size() - 1;
+    const size_t b = std::min(num_bands - 1, static_cast<size_t>((lat - lat_min) * band_scale));
+
+    bool inside = false;
+    for (unsigned k = band_offsets[b]; k < band_offsets[b + 1]; ++k) {
+        const Edge &e = band_edges[k];
+        bool intersect = ((e.y1 > lat) != (e.y2 > lat)) &&
+                         (lon < (e.x2 - e.x1) * (lat - e.y1) / (e.y2 - e.y1) + e.x1);
+        if (intersect) inside = !inside;
+    }
+    return inside;
+}
+
+bool MultiPolygon::contains_linear(double lon, double lat) const {
+    bool inside = false;
+    for (const auto &polygon : polygons) {
+        for (const auto &ring : polygon) {
+            int n = static_cast<int>(ring.size());
+            for (int i = 0, j = n - 1; i < n; j = i++) {
+                double xi = ring[i].first, yi = ring[i].second;
+                double xj = ring[j].first, yj = ring[j].second;
+
+                bool intersect = ((yi > lat) != (yj > lat)) &&
+                                 (lon < (xj - xi) * (lat - yi) / (yj - yi + 0.0) + xi);
+                if (intersect) inside = !inside;
+            }
+        }
+    }
+    return inside;
+}
+
+namespace {
+
+bool read_ring(const Json::Value &json, Ring &ring) {
+    if (!json.isArray()) return false;
+    for (const auto &position : json) {
+        if (!position.isArray() || position.size() < 2 || !position[0].isNumeric() || !position[1].isNumeric()) return false;
+        ring.emplace_back(position[0].asDouble(), position[1].asDouble());
+    }
+    return ring.size() >= 3;
+}
+
+bool read_polygon(const Json::Value &json, std::vector<Ring> &polygon) {
+    if (!json.isArray() || json.empty()) return false;
+    for (const auto &jsonRing : json) {
+        Ring ring;
+        if (!read_ring(jsonRing, ring)) return false;
+        polygon.push_back(std::move(ring));
+    }
+    return true;
+}
+
+// Collect Polygon/MultiPolygon geometries from any GeoJSON object, returns false on malformed coordinates
+bool collect_polygons(const Json::Value &json, MultiPolygon &area) {
+    if (!json.isObject()) return true;
+    const std::string type = json.get("type", "").asString();
+
+    if (type == "FeatureCollection") {
+        for (const auto &feature : json["features"]) {
+            if (!collect_polygons(feature, area)) return false;
+        }
+    }
+    else if (type == "Feature") {
+        return collect_polygons(json["geometry"], area);
+    }
+    else if (type == "GeometryCollection") {
+        for (const auto &geometry : json["geometries"]) {
+            if (!collect_polygons(geometry, area)) return false;
+        }
+    }
+    else if (type == "Polygon") {
+        std::vector<Ring> polygon;
+        if (!read_polygon(json["coordinates"], polygon)) return false;
+        area.polygons.push_back(std::move(polygon));
+    }
+    else if (type == "MultiPolygon") {
+        for (const auto &jsonPolygon : json["coordinates"]) {
+            std::vector<Ring> polygon;
+            if (!read_polygon(jsonPolygon, polygon)) return false;
+            area.polygons.push_back(std::move(polygon));
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool load_geojson_polygon(const std::string &file, MultiPolygon &area) {
+    std::ifstream in(file);
+    if (!in.is_open()) {
+        std::cerr << "Failed to open GeoJSON file: " << file << std::endl;
+        return false;
+    }
+
+    Json::CharReaderBuilder builder;
+    Json::Value root;
+    std::string errors;
+    if (!Json::parseFromStream(builder, in, &root, &errors)) {
+        std::cerr << "Failed to parse GeoJSON file: " << file << " -> " << errors << std::endl;
+        return false;
+    }
+
+    area.polygons.clear();
+    if (!collect_polygons(root, area)) {
+        std::cerr << "Malformed polygon coordinates in GeoJSON file: " << file << std::endl;
+        return false;
+    }
+    if (area.empty()) {
+        std::cerr << "No Polygon or MultiPolygon geometry found in: " << file << std::endl;
+        return false;
+    }
+
+    area.update_bounds();
+    return true;
+}
@@ -0,0 +1,195 @@
+// std libs
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef OSRM_OUTPUT_HAVE_ARROW
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <arrow/ipc/writer.h>
+#include <arrow/util/compression.h>
+#include <parquet/arrow/writer.h>
+#include <parquet/properties.h>
+#endif
+
+#include "TableFile.h"
+
+// ++++++++++++++++++++++++++++++++++++++ FUNCTIONS ++++++++++++++++++++++++++++++++++++++
+
+bool table_file_available() {
+#ifdef OSRM_OUTPUT_HAVE_ARROW
+    return true;
+#else
+    return false;
+#endif
+}
+
+const char *table_file_extension(TableFormat format) {
+    return format == TableFormat::Parquet ? ".parquet" : ".arrows";
+}
+
+#ifdef OSRM_OUTPUT_HAVE_ARROW
+
+namespace {
+
+// Writes record batches to an Arrow IPC stream or a Parquet file
+class batch_writer {
+public:
+    arrow::Status open(const std::string &filename, TableFormat format, const std::shared_ptr<arrow::Schema> &schema) {
+        std::filesystem::path p(filename);
+        if (!p.parent_path().empty()) std::filesystem::create_directories(p.parent_path());
+        ARROW_ASSIGN_OR_RAISE(out_, arrow::io::FileOutputStream::Open(filename));
+        if (format == TableFormat::Arrow) {
+            ARROW_ASSIGN_OR_RAISE(ipc_, arrow::ipc::MakeStreamWriter(out_, schema));
+            return arrow::Status::OK();
+        }
+        parquet::WriterProperties::Builder properties;
+        if (arrow::util::Codec::IsAvailable(arrow::Compression::ZSTD)) properties.compression(parquet::Compression::ZSTD);
+        ARROW_ASSIGN_OR_RAISE(parquet_, parquet::arrow::FileWriter::Open(*schema, arrow::default_memory_pool(), out_, properties.build()));
+        return arrow::Status::OK();
+    }
+
+    arrow::Status write(const arrow::RecordBatch &batch) {
+        if (ipc_) return ipc_->WriteRecordBatch(batch);
+        // One row group per batch
+        ARROW_RETURN_NOT_OK(parquet_->NewBufferedRowGroup());
+        return parquet_->WriteRecordBatch(batch);
+    }
+
+    arrow::Status close() {
+        if (ipc_) ARROW_RETURN_NOT_OK(ipc_->Close());
+        if (parquet_) ARROW_RETURN_NOT_OK(parquet_->Close());
+        return out_->Close();
+    }
+
+private:
+    std::shared_ptr<arrow::io::FileOutputStream> out_;
+    std::shared_ptr<arrow::ipc::RecordBatchWriter> ipc_;
+    std::unique_ptr<parquet::arrow::FileWriter> parquet_;
+};
+
+// Travel matrix value, unset cells become null
+inline void append_value(arrow::Int32Builder &builder, int value) {
+    if (value == TravelMatrix::UNSET) builder.UnsafeAppendNull();
+    else builder.UnsafeAppend(value);
+}
+
+arrow::Status write_long(const std::string &filename, TableFormat format, const TravelMatrix &times, const TravelMatrix &distances,
+                         const RouteStatusMatrix &status, int first_row, const row_wait_fn &wait_row) {
+    auto schema = arrow::schema({arrow::field("from", arrow::int32(), false), arrow::field("to", arrow::int32(), false),
+                                 arrow::field("time", arrow::int32()), arrow::field("distance", arrow::int32()),
+                                 arrow::field("status", arrow::uint8(), false)});
+    batch_writer writer;
+    ARROW_RETURN_NOT_OK(writer.open(filename, format, schema));
+
+    const int rows = times.rows(), cols = times.cols();
+    const int batch_rows = std::max(1, static_cast<int>(TABLE_FILE_BATCH_CELLS / std::max(1, cols)));
+    std::vector<int> time_row(cols), distance_row(cols);
+    arrow::Int32Builder from, to, time, distance;
+    arrow::UInt8Builder state;
+    for (int first = 0; first < rows; first += batch_rows) {
+        const int last = std::min(rows, first + batch_rows);
+        const int64_t cells = static_cast<int64_t>(last - first) * cols;
+        if (wait_row) wait_row(last - 1);
+        ARROW_RETURN_NOT_OK(from.Reserve(cells));
+        ARROW_RETURN_NOT_OK(to.Reserve(cells));
+        ARROW_RETURN_NOT_OK(time.Reserve(cells));
+        ARROW_RETURN_NOT_OK(distance.Reserve(cells));
+        ARROW_RETURN_NOT_OK(state.Reserve(cells));
+        for (int i = first; i < last; ++i) {
+            times.get_row(i, time_row.data());
+            distances.get_row(i, distance_row.data());
+            for (int j = 0; j < cols; ++j) {
+                from.UnsafeAppend(first_row + i);
+                to.UnsafeAppend(j);
+                append_value(time, time_row[j]);
+                append_value(distance, distance_row[j]);
+                state.UnsafeAppend(status.get(i, j));
+            }
+        }
+        std::vector<std::shared_ptr<arrow::Array>> columns(5);
+        ARROW_RETURN_NOT_OK(from.Finish(&columns[0]));
+        ARROW_RETURN_NOT_OK(to.Finish(&columns[1]));
+        ARROW_RETURN_NOT_OK(time.Finish(&columns[2]));
+        ARROW_RETURN_NOT_OK(distance.Finish(&columns[3]));
+        ARROW_RETURN_NOT_OK(state.Finish(&columns[4]));
+        ARROW_RETURN_NOT_OK(writer.write(*arrow::RecordBatch::Make(schema, cells, columns)));
+    }
+    return writer.close();
+}
+
+arrow::Status write_wide(const std::string &filename, TableFormat format, const TravelMatrix &matrix, int first_row, const row_wait_fn &wait_row) {
+    const int rows = matrix.rows(), cols = matrix.cols();
+    arrow::FieldVector fields = {arrow::field("from", arrow::int32(), false)};
+    for (int j = 0; j < cols; ++j) fields.push_back(arrow::field(std::to_string(j), arrow::int32()));
+    auto schema = arrow::schema(fields);
+    batch_writer writer;
+    ARROW_RETURN_NOT_OK(writer.open(filename, format, schema));
+
+    const int batch_rows = std::max(1, static_cast<int>(TABLE_FILE_BATCH_CELLS / std::max(1, cols)));
+    std::vector<int> row(cols);
+    arrow::Int32Builder from;
+    std::vector<arrow::Int32Builder> columns(cols);
+    for (int first = 0; first < rows; first += batch_rows) {
+        const int last = std::min(rows, first + batch_rows);
+        if (wait_row) wait_row(last - 1);
+        ARROW_RETURN_NOT_OK(from.Reserve(last - first));
+        for (auto &column : columns) ARROW_RETURN_NOT_OK(column.Reserve(last - first));
+        for (int i = first; i < last; ++i) {
+            matrix.get_row(i, row.data());
+            from.UnsafeAppend(first_row + i);
+            for (int j = 0; j < cols; ++j) append_value(columns[j], row[j]);
+        }
+        std::vector<std::shared_ptr<arrow::Array>> arrays(cols + 1);
+        ARROW_RETURN_NOT_OK(from.Finish(&arrays[0]));
+        for (int j = 0; j < cols; ++j) ARROW_RETURN_NOT_OK(columns[j].Finish(&arrays[j + 1]));
+        ARROW_RETURN_NOT_OK(writer.write(*arrow::RecordBatch::Make(schema, last - first, arrays)));
+    }
+    return writer.close();
+}
+
+bool report(const arrow::Status &status, const std::string &filename) {
+    if (!status.ok()) std::cerr << "Failed to write " << filename << " -> " << status.ToString() << std::endl;
+    return status.ok();
+}
+
+} // namespace
+
+bool write_matrix_table_long(const std::string &filename, TableFormat format, const TravelMatrix &times, const TravelMatrix &distances,
+                             const RouteStatusMatrix &status, int first_row, const row_wait_fn &wait_row) {
+    try {
+        return report(write_long(filename, format, times, distances, status, first_row, wait_row), filename);
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Failed to write " << filename << " -> " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool write_matrix_table_wide(const std::string &filename, TableFormat format, const TravelMatrix &matrix, int first_row, const row_wait_fn &wait_row) {
+    try {
+        return report(write_wide(filename, format, matrix, first_row, wait_row), filename);
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Failed to write " << filename << " -> " << e.what() << std::endl;
+        return false;
+    }
+}
+
+#else
+
+bool write_matrix_table_long(const std::string &filename, TableFormat, const TravelMatrix &, const TravelMatrix &, const RouteStatusMatrix &, int,
+                             const row_wait_fn &) {
+    std::cerr << "Arrow/Parquet output requested but this build has no Arrow support: " << filename << std::endl;
+    return false;
+}
+
+bool write_matrix_table_wide(const std::string &filename, TableFormat, const TravelMatrix &, int, const row_wait_fn &) {
+    std::cerr << "Arrow/Parquet output requested but this build has no Arrow support: " << filename << std::endl;
+    return false;
+}
+
+#endif
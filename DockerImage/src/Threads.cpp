@@ -0,0 +1,55 @@
+// std libs
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "Threads.h"
+
+// ++++++++++++++++++++++++++++++++++++++ FUNCTIONS ++++++++++++++++++++++++++++++++++++++
+
+double cgroup_cpu_limit() {
+    // cgroup v2: '<quota> <period>' or 'max <period>'
+    {
+        std::ifstream file("/sys/fs/cgroup/cpu.max");
+        std::string quota;
+        double period = 0;
+        if (file >> quota >> period) {
+            if (quota == "max" || period <= 0) return 0.0;
+            try {
+                return std::stod(quota) / period;
+            }
+            catch (const std::exception &) {
+                return 0.0;
+            }
+        }
+    }
+
+    // cgroup v1: quota -1 means unlimited
+    for (const std::string dir : {"/sys/fs/cgroup/cpu,cpuacct/", "/sys/fs/cgroup/cpu/"}) {
+        std::ifstream quota_file(dir + "cpu.cfs_quota_us");
+        std::ifstream period_file(dir + "cpu.cfs_period_us");
+        double quota = 0, period = 0;
+        if (quota_file >> quota && period_file >> period) {
+            return quota > 0 && period > 0 ? quota / period : 0.0;
+        }
+    }
+    return 0.0;
+}
+
+int available_cpus() {
+    int cpus = static_cast<int>(std::thread::hardware_concurrency());
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) cpus = CPU_COUNT(&set);
+#endif
+    const double quota = cgroup_cpu_limit();
+    if (quota > 0) cpus = std::min(cpus, static_cast<int>(std::ceil(quota)));
+    return std::max(1, cpus);
+}
@@ -0,0 +1,103 @@
+// std libs
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "TimeSlices.h"
+
+// ++++++++++++++++++++++++++++++++++++++ FUNCTIONS ++++++++++++++++++++++++++++++++++++++
+
+namespace {
+
+// Dataset files (suffix after '.osrm') that osrm-customize rewrites, these must not be shared with the base dataset
+const std::vector<std::string> customized_suffixes = {
+    ".cell_metrics", ".mldgr", ".geometry", ".datasource_names", ".turn_weight_penalties", ".turn_duration_penalties"};
+
+std::vector<std::string> split(const std::string &value, char separator) {
+    std::vector<std::string> parts;
+    std::stringstream ss(value);
+    std::string part;
+    while (std::getline(ss, part, separator)) {
+        if (!part.empty()) parts.push_back(part);
+    }
+    return parts;
+}
+
+// Single-quote an argument for the shell
+std::string quote(const std::string &arg) {
+    std::string out = "'";
+    for (char c : arg) {
+        if (c == '\'') out += "'\\''";
+        else out += c;
+    }
+    return out + "'";
+}
+
+} // namespace
+
+bool parse_time_slice(const std::string &arg, time_slice &slice) {
+    const auto eq = arg.find('=');
+    if (eq == std::string::npos || eq == 0 || eq + 1 == arg.size()) return false;
+
+    slice.name = arg.substr(0, eq);
+    const std::string files = arg.substr(eq + 1);
+    const auto colon = files.find(':');
+    slice.speed_files = split(files.substr(0, colon), ',');
+    slice.turn_files = colon == std::string::npos ? std::vector<std::string>() : split(files.substr(colon + 1), ',');
+    return !slice.speed_files.empty() || !slice.turn_files.empty();
+}
+
+bool prepare_time_slice(const std::string &basePath, const time_slice &slice, const std::string &sliceDir,
+                        const std::string &customizeBinary, std::string &slicePath) {
+    namespace fs = std::filesystem;
+
+    const fs::path base(basePath);
+    const fs::path baseDir = base.parent_path().empty() ? fs::path(".") : base.parent_path();
+    const std::string prefix = base.filename().string(); // e.g. 'region.osrm'
+    const fs::path dir = fs::path(sliceDir) / slice.name;
+
+    try {
+        fs::create_directories(dir);
+
+        // Share the unchanged dataset files, copy the ones customisation rewrites
+        int files = 0;
+        for (const auto &entry : fs::directory_iterator(baseDir)) {
+            const std::string filename = entry.path().filename().string();
+            if (!entry.is_regular_file() || filename.compare(0, prefix.size(), prefix) != 0) continue;
+            ++files;
+
+            const std::string suffix = filename.substr(prefix.size());
+            const fs::path target = dir / filename;
+            fs::remove(target);
+            bool rewritten = false;
+            for (const auto &s : customized_suffixes) rewritten = rewritten || suffix == s;
+
+            if (rewritten) fs::copy_file(entry.path(), target);
+            else fs::create_symlink(fs::absolute(entry.path()), target);
+        }
+        if (files == 0) {
+            std::cerr << "No dataset files found for " << basePath << std::endl;
+            return false;
+        }
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Failed to prepare time slice " << slice.name << " in " << dir << " -> " << e.what() << std::endl;
+        return false;
+    }
+
+    slicePath = (dir / prefix).string();
+
+    std::string command = quote(customizeBinary) + " " + quote(slicePath);
+    for (const auto &file : slice.speed_files) command += " --segment-speed-file " + quote(file);
+    for (const auto &file : slice.turn_files) command += " --turn-penalty-file " + quote(file);
+
+    std::cout << " - Customising time slice " << slice.name << ": " << command << std::endl;
+    if (std::system(command.c_str()) != 0) {
+        std::cerr << "osrm-customize failed for time slice " << slice.name << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -1,6 +1,9 @@
 // Argument input
 #include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
 #include <boost/program_options.hpp>
+#include <algorithm>
 #include <cstdlib>
 
 // For printing to terminal
@@ -10,8 +13,11 @@
 // ----------------------------------------------------------- GLOBAL PARAMETERS -----------------------------------------------------------
 
 // OSRM
+#include "MatrixFile.h"
 #include "OSRM_Engine.h"
 #include "OSRMParameters.h"
+#include "Planner.h"
+#include "Sharding.h"
 
 // Termination handling
 #include <csignal>
@@ -27,13 +33,71 @@ int main(int argumentCount, char *argumentVariables[]) {
     boost::program_options::options_description argumentDescription("Allowed options:");
     argumentDescription.add_options() // description of the arguments
         ("help", "Produces help message.")
-        ("osrm-path", boost::program_options::value<std::string>(), "Path to OSRM data, this should end with '.osrm' (e.g. '/osrm/belgium/belgium.osrm').")
+        ("osrm-path", boost::program_options::value<std::vector<std::string>>()->composing(), "Path to OSRM data, this should end with '.osrm' (e.g. '/osrm/belgium/belgium.osrm'). Repeat as 'name=path' (e.g. 'car=/osrm/car/belgium.osrm') to compute matrices for several profiles in one run.")
+        ("algorithm", boost::program_options::value<std::string>()->default_value("ch"), "Routing algorithm the datasets were prepared for: 'ch' (osrm-contract) or 'mld' (osrm-partition + osrm-customize).")
+        ("time-slice", boost::program_options::value<std::vector<std::string>>()->composing(), "Time slice of an MLD dataset as 'name=speeds.csv[,...][:turns.csv[,...]]'. Repeat for several slices (e.g. peak and offpeak); the dataset is re-customised per slice and one matrix is computed per slice.")
+        ("customize-binary", boost::program_options::value<std::string>()->default_value("osrm-customize"), "osrm-customize executable used to prepare time slices.")
+        ("matrix-bits", boost::program_options::value<int>()->default_value(32), "Bits per stored matrix cell: 32, 24 or 16. Values that don't fit are clamped and reported.")
+        ("time-unit", boost::program_options::value<double>()->default_value(1.0), "Resolution of stored travel times in seconds (e.g. 10 stores times in 10 s steps).")
+        ("distance-unit", boost::program_options::value<double>()->default_value(1.0), "Resolution of stored travel distances in meters (e.g. 10 stores distances in 10 m steps).")
+        ("output-format", boost::program_options::value<std::string>()->default_value("csv"), "Comma separated matrix output formats: 'csv', 'bin' (raw binary matrix), 'zst' (row-delta + zstd compressed binary matrix), 'status' (route status per cell), 'arrow' (Arrow IPC stream) and/or 'parquet'.")
+        ("table-layout", boost::program_options::value<std::string>()->default_value("long"), "Layout of the arrow and parquet outputs: 'long' (one from, to, time, distance, status record per cell, one file) or 'wide' (one record per origin, one column per destination, a file per matrix).")
+        ("max-snap-distance", boost::program_options::value<double>(), "Snap pre-flight: snap every location once with the Nearest service and write results/snap_report.csv. Locations snapping further than this many meters (or not at all) are flagged: their cells get the outside-extract fallback without routing.")
+        ("snap-exclude", "With --max-snap-distance, drop flagged locations before routing instead.")
+        ("fallback", boost::program_options::value<std::vector<string>>()->composing(), "Fallback estimate for cells OSRM can't route, as 'same-place|outside-extract|error=detour:speed' (distance = haversine * detour, time = distance / speed in m/s). Defaults: same-place=1.5:14, outside-extract=1.5:14, error=2:12. Can be given several times.")
+        ("threads", boost::program_options::value<int>()->default_value(0), "Routing threads (compute bound). 0 = one per available CPU, respecting the CPU affinity mask and cgroup CPU quota.")
+        ("write-threads", boost::program_options::value<int>()->default_value(0), "Threads for loading coordinates and writing output files (I/O bound). 0 = one per available CPU.")
+        ("affinity", boost::program_options::value<string>(), "Pin routing thread k to the k-th CPU of this list (round robin), e.g. '0-7,16-23'. Ignored with --numa.")
+        ("thread-benchmark", boost::program_options::value<int>(), "Benchmark only: route this many random pairs with 1, 2, 4, ... up to --threads threads and print the throughput.")
+        ("route-order", boost::program_options::value<string>()->default_value("none"), "Order in which the locations are routed: none (file order), hilbert or morton. A space-filling curve keeps consecutive routes in the same part of the road graph for better cache locality; the outputs keep the file order.")
+        ("reorder-benchmark", boost::program_options::value<int>(), "Benchmark only: route about this many pairs between random locations in file order and in --route-order (default hilbert) order and print the throughput of both.")
+        ("perf-counters", "Profile a full matrix run with hardware counters (perf_event_open, Linux): instructions, cycles, cache misses and dTLB misses per cell of the routing workers and csv writers. Not available with the other modes, --manifest or benchmarks.")
+        ("numa", "Pin the routing threads per NUMA node; every node routes a contiguous range of rows and then helps the other nodes.")
+        ("numa-replicas", "With --numa, load one engine replica per NUMA node so graph traversal stays in node-local memory (multiplies engine memory by the number of nodes).")
+        ("numa-benchmark", boost::program_options::value<int>(), "Benchmark only: route this many random pairs using 1 up to all NUMA nodes and print the throughput (implies --numa).")
+        ("max-duration", boost::program_options::value<double>(), "Sparse mode: only keep the pairs with a travel time within this many seconds and write them to results/travel_pairs.csv instead of full matrices. Pairs whose straight line distance at --max-speed already takes longer are never routed.")
+        ("max-distance", boost::program_options::value<double>(), "Sparse mode: only keep the pairs within this many meters of road distance (can be combined with --max-duration). Pairs further apart in a straight line are never routed.")
+        ("max-speed", boost::program_options::value<double>()->default_value(130.0), "Sparse mode: highest speed of the routing profile in km/h, used to prune pairs against --max-duration. Too low a value drops pairs that are in reach.")
+        ("symmetric", "Symmetric approximation: only route pairs i < j and mirror them (A->B = B->A), halving routing time and matrix memory.")
+        ("symmetric-audit", boost::program_options::value<int>()->default_value(0), "With --symmetric, route this many random reverse pairs and report the asymmetry error.")
+        ("approximate", boost::program_options::value<int>(), "Cluster approximation for huge location sets: split the locations into this many clusters, route the centroid matrix and every location's legs to its centroid, and write the model to results/cluster_*.csv instead of full matrices (see ClusterMatrix.h).")
+        ("approximate-audit", boost::program_options::value<int>()->default_value(1000), "With --approximate, route this many random pairs exactly and report the approximation error.")
+        ("circuity", boost::program_options::value<int>(), "Fast estimates: route a stratified sample of this many pairs, fit road distance and time per straight line distance band and region grid cell, and fill the full matrices with the model's estimates.")
+        ("circuity-audit", boost::program_options::value<int>()->default_value(1000), "With --circuity, route this many held-out random pairs and report the error of the estimates.")
+        ("circuity-grid", boost::program_options::value<int>()->default_value(4), "With --circuity, region grid cells per side over the bounding box of the locations.")
+        ("reduce", boost::program_options::value<string>(), "Streaming reductions instead of matrices, comma separated: nearest[:K] (K nearest destinations by time, default 1, results/nearest.csv), stats (per-row time and distance statistics, results/row_stats.csv), histogram[:WIDTH[:BINS]] (per-row travel time histogram, default 600 s x 12 bins, results/row_histograms.csv). Memory stays O(locations).")
+        ("destinations", boost::program_options::value<string>(), "With --reduce, coordinates file of the destinations (e.g. depots); default: all locations. Text or binary, the format follows the extension.")
+        ("geometry-pairs", boost::program_options::value<string>(), "Export the route geometry (encoded polyline) of the 'from to' location index pairs in this file to results/geometries.osrmgeo.")
+        ("geometry-annotations", "With --geometry-pairs, also export the per-segment durations and distances of every route.")
+        ("memory-limit", boost::program_options::value<string>(), "Budget planner: peak memory of the run (e.g. 64G, 512M; plain numbers are MB). The planner measures the loaded datasets, then picks a smaller matrix encoding (unless --matrix-bits or a unit is given) or a sharded run so the matrices fit, and prints its decision. Sharding is its only streaming strategy: it never switches to --reduce or sparse mode and keeps the fixed row block size.")
+        ("deadline", boost::program_options::value<string>(), "Budget planner: abort before routing if the runtime estimated from a calibration sample exceeds this (e.g. 90m, 2h; plain numbers are seconds).")
+        ("plan", "Only print the budget plan (memory and runtime estimates, chosen strategy) and exit without routing.")
+        ("shards", boost::program_options::value<int>(), "Coordinate a sharded run: split the origins into this many row shards, let worker processes compute them and merge their outputs (csv, bin and status formats).")
+        ("shard-workers", boost::program_options::value<int>()->default_value(1), "With --shards, number of local worker processes to start; 0 only waits for external workers on other hosts.")
+        ("shard-dir", boost::program_options::value<string>()->default_value("/app/results/shards"), "With --shards, directory shared with the workers (local disk, or a network filesystem for workers on other hosts).")
+        ("shard-worker", boost::program_options::value<string>(), "Run as a worker of the sharded run in this directory: claim and compute row shards until none are left. The other options are read from the job.")
+        ("manifest", boost::program_options::value<string>(), "Batch jobs: file with one '<coordinates file> <output directory>' job per line. All jobs are routed in one process with the datasets loaded once, several jobs at a time, each writing its csv (and status) matrices to its own directory.")
         ("coordinates-path", boost::program_options::value<std::string>(), "Path to coordinates, this should be a .txt file (e.g. '/data/coordinates.txt').")
+        ("sample-count", boost::program_options::value<int>()->default_value(100), "Number of random locations to sample when no coordinates file is given.")
+        ("sample-polygon", boost::program_options::value<std::string>(), "GeoJSON file with the (Multi)Polygon to sample in, defaults to a central-Belgium polygon.")
+        ("service-area", boost::program_options::value<std::string>(), "GeoJSON file with the (Multi)Polygon of the service area, locations outside it are dropped before routing.")
+        ("seed", boost::program_options::value<uint64_t>(), "Seed for random sampling, runs with the same seed sample the same locations.")
+        ("coordinates-format", boost::program_options::value<std::string>()->default_value("auto"), "Coordinates file format: 'text', 'f64' or 'f32' (raw lon/lat pairs), or 'auto' to decide from the extension (.f64/.bin, .f32).")
     ;
 
     // variables to read in the program options
     boost::program_options::variables_map variableMap;
-    boost::program_options::store(boost::program_options::parse_command_line(argumentCount, argumentVariables, argumentDescription), variableMap);
+    const auto parsedOptions = boost::program_options::parse_command_line(argumentCount, argumentVariables, argumentDescription);
+    boost::program_options::store(parsedOptions, variableMap);
+
+    // A shard worker takes its options from the job, plus the ones given on its own command line (e.g. --threads)
+    if (variableMap.count("shard-worker")) {
+        std::vector<string> workerArguments;
+        if (!read_shard_job_args(variableMap["shard-worker"].as<string>(), workerArguments)) return EXIT_FAILURE;
+        workerArguments.insert(workerArguments.end(), argumentVariables + 1, argumentVariables + argumentCount);
+        variableMap.clear();
+        boost::program_options::store(boost::program_options::command_line_parser(workerArguments).options(argumentDescription).run(), variableMap);
+    }
     boost::program_options::notify(variableMap);
 
     // help function
@@ -45,28 +109,264 @@ int main(int argumentCount, char *argumentVariables[]) {
     // osrm struct
     osrm_params OSRM;
 
-    // OSRM path
+    // routing algorithm
+    const string algorithm = boost::algorithm::to_lower_copy(variableMap["algorithm"].as<string>());
+    if (algorithm == "mld") OSRM.algorithm = osrm::EngineConfig::Algorithm::MLD;
+    else if (algorithm != "ch") throw std::invalid_argument("Unknown --algorithm, use 'ch' or 'mld'.");
+
+    // OSRM paths, optionally named ('name=path'), unnamed datasets are named after their file
     if (variableMap.count("osrm-path")) {
-        OSRM.pathTo_OSM_data = variableMap["osrm-path"].as<string>();
+        for (const auto &arg : variableMap["osrm-path"].as<std::vector<string>>()) {
+            const auto eq = arg.find('=');
+            const string name = eq == string::npos ? std::filesystem::path(arg).stem().string() : arg.substr(0, eq);
+            const string path = eq == string::npos ? arg : arg.substr(eq + 1);
+            if (!OSRM.add_dataset(name, path)) {
+                throw std::invalid_argument("Dataset '" + name + "' given twice, name them with --osrm-path name=path.");
+            }
+        }
     }
     else throw std::invalid_argument("No path to OSRM data provided, use --osrm-path to provide it.");
 
-    // coordinates path
-    if(variableMap.count("coordinates-path")) {
+    // matrix storage and output
+    OSRM.time_encoding.bits = OSRM.distance_encoding.bits = variableMap["matrix-bits"].as<int>();
+    OSRM.time_encoding.unit = variableMap["time-unit"].as<double>();
+    OSRM.distance_encoding.unit = variableMap["distance-unit"].as<double>();
+    {
+        std::vector<string> formats;
+        boost::algorithm::split(formats, variableMap["output-format"].as<string>(), boost::algorithm::is_any_of(","));
+        OSRM.output_csv = false;
+        for (const auto &format : formats) {
+            if (format == "csv") OSRM.output_csv = true;
+            else if (format == "bin") OSRM.output_binary = true;
+            else if (format == "zst" && matrix_file_compression_available()) OSRM.output_compressed = true;
+            else if (format == "zst") throw std::invalid_argument("--output-format zst needs a build with zstd.");
+            else if (format == "status") OSRM.output_status = true;
+            else if ((format == "arrow" || format == "parquet") && !table_file_available()) throw std::invalid_argument("--output-format " + format + " needs a build with Apache Arrow.");
+            else if (format == "arrow") OSRM.output_arrow = true;
+            else if (format == "parquet") OSRM.output_parquet = true;
+            else throw std::invalid_argument("Unknown --output-format '" + format + "', use 'csv', 'bin', 'zst', 'status', 'arrow' or 'parquet'.");
+        }
+        const string layout = variableMap["table-layout"].as<string>();
+        if (layout == "long") OSRM.table_layout = TableLayout::Long;
+        else if (layout == "wide") OSRM.table_layout = TableLayout::Wide;
+        else throw std::invalid_argument("Unknown --table-layout '" + layout + "', use 'long' or 'wide'.");
+    }
+
+    // fallback policy
+    if (variableMap.count("fallback")) {
+        for (const auto &rule : variableMap["fallback"].as<std::vector<string>>()) {
+            if (!OSRM.fallback.parse(rule)) throw std::invalid_argument("Invalid --fallback '" + rule + "', expected 'same-place|outside-extract|error=detour:speed'.");
+        }
+    }
+
+    // snap pre-flight
+    if (variableMap.count("max-snap-distance")) {
+        OSRM.max_snap_distance = variableMap["max-snap-distance"].as<double>();
+        if (!(OSRM.max_snap_distance > 0)) throw std::invalid_argument("--max-snap-distance must be positive.");
+    }
+    OSRM.snap_exclude = variableMap.count("snap-exclude") > 0;
+
+    // NUMA placement
+    OSRM.numa_replicas = variableMap.count("numa-replicas") > 0;
+    OSRM.perf_counters = variableMap.count("perf-counters") > 0;
+    if (variableMap.count("numa-benchmark")) OSRM.numa_benchmark_pairs = variableMap["numa-benchmark"].as<int>();
+    OSRM.numa = variableMap.count("numa") > 0 || OSRM.numa_replicas || OSRM.numa_benchmark_pairs > 0;
+
+    // sparse mode
+    if (variableMap.count("max-duration")) OSRM.max_duration = variableMap["max-duration"].as<double>();
+    if (variableMap.count("max-distance")) OSRM.max_distance = variableMap["max-distance"].as<double>();
+    OSRM.max_speed = variableMap["max-speed"].as<double>() / 3.6;
+    if (OSRM.max_duration < 0 || OSRM.max_distance < 0 || !(OSRM.max_speed > 0)) {
+        throw std::invalid_argument("--max-duration and --max-distance can't be negative, --max-speed must be positive.");
+    }
+
+    // symmetric approximation
+    OSRM.symmetric = variableMap.count("symmetric") > 0;
+    OSRM.symmetric_audit_samples = variableMap["symmetric-audit"].as<int>();
+    if (OSRM.sparse() && (OSRM.symmetric || OSRM.output_binary || OSRM.output_compressed || OSRM.output_status || OSRM.output_arrow || OSRM.output_parquet)) {
+        throw std::invalid_argument("--max-duration and --max-distance write travel_pairs.csv only, without --symmetric or other output formats.");
+    }
+
+    // streaming reductions
+    if (variableMap.count("reduce")) {
+        std::vector<string> reductions;
+        boost::algorithm::split(reductions, variableMap["reduce"].as<string>(), boost::algorithm::is_any_of(","));
+        for (const auto &reduction : reductions) {
+            std::vector<string> parts;
+            boost::algorithm::split(parts, reduction, boost::algorithm::is_any_of(":"));
+            if (parts[0] == "nearest" && parts.size() <= 2) OSRM.reduce_nearest = parts.size() == 2 ? std::stoi(parts[1]) : 1;
+            else if (parts[0] == "stats" && parts.size() == 1) OSRM.reduce_stats = true;
+            else if (parts[0] == "histogram" && parts.size() <= 3) {
+                OSRM.reduce_histogram_width = parts.size() >= 2 ? std::stod(parts[1]) : 600;
+                OSRM.reduce_histogram_bins = parts.size() == 3 ? std::stoi(parts[2]) : 12;
+                if (!(OSRM.reduce_histogram_width > 0) || OSRM.reduce_histogram_bins <= 0) throw std::invalid_argument("--reduce histogram needs a positive bin width and number of bins.");
+            }
+            else throw std::invalid_argument("Unknown --reduce '" + reduction + "', use nearest[:K], stats or histogram[:WIDTH[:BINS]].");
+        }
+        if (!OSRM.reduction()) throw std::invalid_argument("--reduce nearest needs a positive K.");
+        if (OSRM.sparse() || OSRM.symmetric || OSRM.output_binary || OSRM.output_compressed || OSRM.output_status || OSRM.output_arrow || OSRM.output_parquet) {
+            throw std::invalid_argument("--reduce writes per-row results only, without --max-duration, --max-distance, --symmetric or other output formats.");
+        }
+    }
+    if (variableMap.count("destinations")) {
+        if (!OSRM.reduction()) throw std::invalid_argument("--destinations is only used with --reduce.");
+        OSRM.pathTO_destinations = variableMap["destinations"].as<string>();
+    }
+
+    // cluster approximation
+    if (variableMap.count("approximate")) OSRM.approximate_clusters = variableMap["approximate"].as<int>();
+    OSRM.approximate_audit_samples = variableMap["approximate-audit"].as<int>();
+    if (OSRM.approximate_clusters < 0 || OSRM.approximate_audit_samples < 0) throw std::invalid_argument("--approximate and --approximate-audit can't be negative.");
+    if (OSRM.approximate_clusters > 0 && (OSRM.sparse() || OSRM.reduction() || OSRM.symmetric || OSRM.output_binary || OSRM.output_compressed || OSRM.output_status || OSRM.output_arrow || OSRM.output_parquet)) {
+        throw std::invalid_argument("--approximate writes the cluster model only, without --max-duration, --max-distance, --reduce, --symmetric or other output formats.");
+    }
+
+    // circuity model
+    if (variableMap.count("circuity")) OSRM.circuity_samples = variableMap["circuity"].as<int>();
+    OSRM.circuity_audit_samples = variableMap["circuity-audit"].as<int>();
+    OSRM.circuity_grid = variableMap["circuity-grid"].as<int>();
+    if (OSRM.circuity_samples < 0 || OSRM.circuity_audit_samples < 0 || OSRM.circuity_grid < 1) {
+        throw std::invalid_argument("--circuity and --circuity-audit can't be negative, --circuity-grid must be at least 1.");
+    }
+    // Estimated cells have no route status, so neither the status output nor the status column of long tables
+    const bool long_tables = (OSRM.output_arrow || OSRM.output_parquet) && OSRM.table_layout == TableLayout::Long;
+    if (OSRM.circuity_samples > 0 && (OSRM.sparse() || OSRM.reduction() || OSRM.approximate_clusters > 0 || OSRM.symmetric || OSRM.output_status || long_tables)) {
+        throw std::invalid_argument("--circuity fills full matrices, without --max-duration, --max-distance, --reduce, --approximate, --symmetric, the status output "
+                                    "or long arrow/parquet tables (use --table-layout wide).");
+    }
+
+    // geometry export
+    if (variableMap.count("geometry-pairs")) OSRM.geometry_pairs_path = variableMap["geometry-pairs"].as<string>();
+    OSRM.geometry_annotations = variableMap.count("geometry-annotations") > 0;
+
+    // time slices
+    if (variableMap.count("time-slice")) {
+        for (const auto &arg : variableMap["time-slice"].as<std::vector<string>>()) {
+            time_slice slice;
+            if (!parse_time_slice(arg, slice)) {
+                throw std::invalid_argument("Malformed --time-slice '" + arg + "', use 'name=speeds.csv[:turns.csv]'.");
+            }
+            OSRM.time_slices.push_back(slice);
+        }
+        OSRM.customize_binary = variableMap["customize-binary"].as<string>();
+    }
+
+    // thread pools, sized before any parallel loading or sampling
+    OSRM.configure_threads(variableMap["threads"].as<int>(), variableMap["write-threads"].as<int>());
+    if (variableMap.count("affinity")) {
+        OSRM.affinity = parse_cpu_list(variableMap["affinity"].as<string>());
+        if (OSRM.affinity.empty()) throw std::invalid_argument("Invalid --affinity, expected a CPU list like '0-7,16-23'.");
+    }
+    if (variableMap.count("thread-benchmark")) OSRM.thread_benchmark_pairs = variableMap["thread-benchmark"].as<int>();
+
+    // route order
+    if (!parse_curve(variableMap["route-order"].as<string>(), OSRM.route_curve)) {
+        throw std::invalid_argument("Invalid --route-order, expected none, hilbert or morton.");
+    }
+    if (variableMap.count("reorder-benchmark")) {
+        OSRM.reorder_benchmark_pairs = variableMap["reorder-benchmark"].as<int>();
+        if (OSRM.route_curve == curve_type::None) OSRM.route_curve = curve_type::Hilbert;
+    }
+
+    // hardware counters, only the full matrix run is instrumented
+    if (OSRM.perf_counters && (OSRM.sparse() || OSRM.reduction() || OSRM.approximate_clusters > 0 || OSRM.circuity_samples > 0 || OSRM.thread_benchmark_pairs > 0 ||
+                               OSRM.numa_benchmark_pairs > 0 || OSRM.reorder_benchmark_pairs > 0)) {
+        throw std::invalid_argument("--perf-counters profiles full matrix runs only, without --max-duration, --max-distance, --reduce, --approximate, --circuity or benchmarks.");
+    }
+
+    // budget planner
+    OSRM.encoding_explicit = !variableMap["matrix-bits"].defaulted() || !variableMap["time-unit"].defaulted() || !variableMap["distance-unit"].defaulted();
+    if (variableMap.count("memory-limit") && !parse_memory_size(variableMap["memory-limit"].as<string>(), OSRM.memory_limit)) {
+        throw std::invalid_argument("Invalid --memory-limit, expected a size like 64G or 512M.");
+    }
+    if (variableMap.count("deadline") && !parse_duration(variableMap["deadline"].as<string>(), OSRM.deadline)) {
+        throw std::invalid_argument("Invalid --deadline, expected a duration like 90m or 2h.");
+    }
+    OSRM.plan_only = variableMap.count("plan") > 0;
+
+    // sharded runs
+    if (variableMap.count("shard-worker")) {
+        OSRM.shard_worker_dir = variableMap["shard-worker"].as<string>();
+    }
+    else if (variableMap.count("shards")) {
+        OSRM.shards = variableMap["shards"].as<int>();
+        OSRM.shard_workers = variableMap["shard-workers"].as<int>();
+        OSRM.shard_dir = variableMap["shard-dir"].as<string>();
+        if (OSRM.shards <= 0 || OSRM.shard_workers < 0) throw std::invalid_argument("--shards must be positive and --shard-workers not negative.");
+        if (!OSRM.shardable()) {
+            throw std::invalid_argument("Sharded runs support " + osrm_params::shardable_options() + ".");
+        }
+    }
+    if (OSRM.shards > 0 || (OSRM.memory_limit > 0 && OSRM.shard_worker_dir.empty())) {
+        // The planner may switch to a sharded run with one local worker
+        if (OSRM.shards == 0) OSRM.shard_dir = variableMap["shard-dir"].as<string>();
+
+        // Workers get the routing options; the locations are handed over by the coordinator, and thread
+        // pools, CPU placement and planning are decided per worker host
+        const std::vector<string> coordinatorOnly = {"shards", "shard-workers", "shard-dir", "coordinates-path", "coordinates-format", "sample-count",
+                                                     "sample-polygon", "seed", "service-area", "max-snap-distance", "threads", "write-threads", "affinity",
+                                                     "memory-limit", "deadline", "plan", "help"};
+        for (const auto &option : parsedOptions.options) {
+            if (std::find(coordinatorOnly.begin(), coordinatorOnly.end(), option.string_key) != coordinatorOnly.end()) continue;
+            OSRM.shard_job_args.insert(OSRM.shard_job_args.end(), option.original_tokens.begin(), option.original_tokens.end());
+        }
+
+        std::error_code ec;
+        const auto self = std::filesystem::read_symlink("/proc/self/exe", ec);
+        OSRM.executable = ec ? std::filesystem::absolute(argumentVariables[0]).string() : self.string();
+    }
+
+    // batch jobs, their locations come from the manifest
+    if (variableMap.count("manifest")) {
+        OSRM.manifest_path = variableMap["manifest"].as<string>();
+        cout << "-------- Running the jobs of manifest: " << OSRM.manifest_path << endl;
+        if (!parse_coordinate_format(variableMap["coordinates-format"].as<string>(), OSRM.coordinates_format)) {
+            throw std::invalid_argument("Unknown --coordinates-format, use 'auto', 'text', 'f64' or 'f32'.");
+        }
+        if (variableMap.count("coordinates-path") || variableMap.count("service-area") || OSRM.output_binary || OSRM.output_compressed || OSRM.output_arrow ||
+            OSRM.output_parquet || OSRM.symmetric || OSRM.sparse() || OSRM.reduction() || OSRM.approximate_clusters > 0 || OSRM.circuity_samples > 0 || OSRM.max_snap_distance > 0 ||
+            !OSRM.geometry_pairs_path.empty() || OSRM.shards > 0 || !OSRM.shard_worker_dir.empty() || OSRM.memory_limit > 0 || OSRM.deadline > 0 ||
+            OSRM.plan_only || OSRM.perf_counters || OSRM.thread_benchmark_pairs > 0 || OSRM.numa_benchmark_pairs > 0 || OSRM.reorder_benchmark_pairs > 0) {
+            throw std::invalid_argument("--manifest jobs write csv and status matrices only; it can't be combined with --coordinates-path, sampling options, "
+                                        "other modes, sharding, the planner, --perf-counters or benchmarks.");
+        }
+    }
+    else if(variableMap.count("coordinates-path")) {
         OSRM.pathTO_coordinates = variableMap["coordinates-path"].as<string>();
         cout << "-------- Loading coordinates from file: " << OSRM.pathTO_coordinates << endl;
+        if (!parse_coordinate_format(variableMap["coordinates-format"].as<string>(), OSRM.coordinates_format)) {
+            throw std::invalid_argument("Unknown --coordinates-format, use 'auto', 'text', 'f64' or 'f32'.");
+        }
     }   
     else {
         cout << "-------- No path to coordinates provided, using random sampling." << endl;
-        OSRM.sample_locations_in_belgium(100); // sample 100 random locations in Belgium if no coordinates file is provided
+        OSRM.seed = variableMap.count("seed") ? variableMap["seed"].as<uint64_t>() : std::random_device{}();
+        const int sampleCount = variableMap["sample-count"].as<int>();
+        if (variableMap.count("sample-polygon")) {
+            const string polygonPath = variableMap["sample-polygon"].as<string>();
+            MultiPolygon area;
+            if (!load_geojson_polygon(polygonPath, area)) {
+                throw std::invalid_argument("Could not read a polygon from --sample-polygon " + polygonPath);
+            }
+            OSRM.sample_locations_in_area(area, sampleCount, polygonPath);
+        }
+        else {
+            OSRM.sample_locations_in_belgium(sampleCount); // sample random locations in central Belgium if no polygon is provided
+        }
         // Save sampled coordinates for reproducibility
-        if (OSRM.save_coordinates_to_file("results/coordinates.txt")) {
+        if (OSRM.save_coordinates_to_file("/app/results/coordinates.txt")) {
             cout << "Sampled coordinates written to results/coordinates.txt" << endl;
         }
     }
 
-    // start the engine
-    OSRM.start_engine();
+    // service area filter
+    if (variableMap.count("service-area")) {
+        const string areaPath = variableMap["service-area"].as<string>();
+        if (!load_geojson_polygon(areaPath, OSRM.service_area)) {
+            throw std::invalid_argument("Could not read a polygon from --service-area " + areaPath);
+        }
+        cout << "-------- Service area: " << areaPath << " (" << OSRM.service_area.vertex_count() << " vertices)" << endl;
+    }
 
     // Do osrm calculations
     calculate_osrm_metrics(OSRM);
@@ -0,0 +1,72 @@
+#ifndef CIRCUITY_MODEL_H
+#define CIRCUITY_MODEL_H
+
+// std libs
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Circuity model: fast estimates of the road distance and travel time of a pair from its straight line
+// (haversine) distance, for what-if runs where routing every pair is too slow. Pairs are grouped into strata
+// by the grid cell of the origin (`grid` x `grid` cells over the bounding box of the locations) and by
+// straight line distance band (CIRCUITY_BAND_EDGES). Every stratum has its own
+//   circuity = road distance / straight line distance   and   pace = travel time / straight line distance
+// fitted as the median ratios of routed sample pairs; strata with fewer than CIRCUITY_MIN_SAMPLES samples
+// use the factors of their distance band over all cells. An estimate is one haversine and a table lookup.
+
+#define CIRCUITY_MIN_SAMPLES 8
+
+// Upper edges of the straight line distance bands in meters, the last band is open ended
+constexpr double CIRCUITY_BAND_EDGES[] = {500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000};
+constexpr int CIRCUITY_BANDS = sizeof(CIRCUITY_BAND_EDGES) / sizeof(CIRCUITY_BAND_EDGES[0]) + 1;
+
+// A routed pair: origin location, straight line distance (m), road distance (m) and travel time (s)
+struct circuity_sample {
+    int from;
+    double straight;
+    double distance;
+    double time;
+};
+
+class CircuityModel {
+public:
+    // Grid and per location terms of the `n` (longitude, latitude) `coordinates`
+    CircuityModel(double **coordinates, int n, int grid);
+
+    int strata() const { return static_cast<int>(cell_circuity_.size()); }
+    int stratum(int from, double straight) const { return cell_[from] * CIRCUITY_BANDS + band(straight); }
+    static int band(double straight);
+
+    // Straight line distance (m) between locations i and j, from the precomputed terms
+    double straight(int i, int j) const {
+        const double dlat = std::sin((lat_[j] - lat_[i]) / 2), dlon = std::sin((lon_[j] - lon_[i]) / 2);
+        const double a = dlat * dlat + cos_lat_[i] * cos_lat_[j] * dlon * dlon;
+        return 2 * EARTH_RADIUS_M * std::asin(std::sqrt(std::min(1.0, a)));
+    }
+
+    // Fit the factors of every stratum. Returns the number of strata fitted from their own samples, -1 if
+    // there is no usable sample at all.
+    int fit(const std::vector<circuity_sample> &samples);
+
+    // Estimated road distance (m) and travel time (s) from location i to location j
+    void estimate(int i, int j, int &distance, int &time) const {
+        const double s = straight(i, j);
+        const int k = stratum(i, s);
+        distance = static_cast<int>(s * cell_circuity_[k] + 0.5);
+        time = static_cast<int>(s * cell_pace_[k] + 0.5);
+    }
+
+    // Median circuity and pace (s/m) over the samples of the last fit
+    double median_circuity() const { return median_circuity_; }
+    double median_pace() const { return median_pace_; }
+
+private:
+    static constexpr double EARTH_RADIUS_M = 6371000.0;
+
+    std::vector<double> lat_, lon_, cos_lat_; // Radians
+    std::vector<int> cell_;                   // Grid cell per location
+    std::vector<double> cell_circuity_, cell_pace_; // Per stratum
+    double median_circuity_ = 0, median_pace_ = 0;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef CLUSTER_MATRIX_H
+#define CLUSTER_MATRIX_H
+
+// std libs
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Cluster approximation of a travel matrix for location sets too large to route exactly (N in the hundreds
+// of thousands). The locations are split into K cells by recursive median cuts along the wider side of the
+// cell (a k-d tree, so cells hold about N / K locations each) and every cell is represented by its centroid:
+// the member closest to the cell's mean. Only the K x K centroid matrix and the access legs of every location
+// (location -> own centroid, own centroid -> location) are routed, K² + 2N routes instead of N². Entries are
+// composed on demand:
+//   time(i, j) = out(i) + centroid(c(i), c(j)) + in(j)   (0 on the diagonal)
+// The error comes from the detour via the centroids and shrinks as K grows.
+//
+// Files (CSV, no header), written to and read from one directory:
+//   cluster_locations.csv : per location "cluster,out_time,out_distance,in_time,in_distance"
+//   cluster_centroids.csv : per cluster the location index of its centroid
+//   cluster_times.csv, cluster_distances.csv : the K x K centroid matrices
+
+// Cluster of every location and the centroid location of every cluster
+struct location_clusters {
+    std::vector<int> cluster;  // Per location, 0 .. K - 1
+    std::vector<int> centroid; // Per cluster, a location index
+};
+
+// Split the `n` (longitude, latitude) `coordinates` into `k` clusters (fewer if there are fewer locations)
+location_clusters cluster_locations(double **coordinates, int n, int k);
+
+class ClusterMatrix {
+public:
+    location_clusters clusters;
+
+    // Access legs per location, in seconds and meters: location -> centroid and centroid -> location
+    std::vector<int32_t> out_time, out_distance, in_time, in_distance;
+
+    // Centroid travel times and distances, row-major K x K
+    std::vector<int32_t> centroid_time, centroid_distance;
+
+    int locations() const { return static_cast<int>(clusters.cluster.size()); }
+    int size() const { return static_cast<int>(clusters.centroid.size()); }
+
+    // Approximate travel time (s) and distance (m) from location i to location j
+    int time(int i, int j) const {
+        if (i == j) return 0;
+        return out_time[i] + centroid_time[static_cast<size_t>(clusters.cluster[i]) * size() + clusters.cluster[j]] + in_time[j];
+    }
+    int distance(int i, int j) const {
+        if (i == j) return 0;
+        return out_distance[i] + centroid_distance[static_cast<size_t>(clusters.cluster[i]) * size() + clusters.cluster[j]] + in_distance[j];
+    }
+
+    // Write or read the files in `dir`. Return false on failure.
+    bool write(const std::string &dir) const;
+    bool read(const std::string &dir);
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef GEOMETRY_FILE_H
+#define GEOMETRY_FILE_H
+
+// std libs
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Route geometry file layout (all integers native-endian, i.e. little-endian on the supported hosts):
+//   header : geometry_file_header
+//   blobs  : one blob per exported pair, appended in the order the routes complete:
+//              uint32 polyline length, polyline characters (precision 1e6, no terminator),
+//              uint32 annotated segments s, float32 durations[s] (seconds), float32 distances[s] (meters)
+//   index  : geometry_index_entry[count] at `index_offset`, in the order of the pair list
+// Blobs are streamed to disk as routes complete; only the index is kept in memory and written last.
+struct geometry_file_header {
+    char magic[8] = {'O', 'S', 'R', 'M', 'G', 'E', 'O', '1'};
+    uint64_t count = 0;        // Number of index entries
+    uint64_t index_offset = 0; // Absolute file offset of the index
+    uint32_t flags = 0;        // GEOMETRY_FILE_ANNOTATIONS
+    uint32_t reserved = 0;
+};
+
+#define GEOMETRY_FILE_ANNOTATIONS 1u
+
+// Status of an exported pair
+#define GEOMETRY_ROUTED 0u    // Blob holds the route
+#define GEOMETRY_NO_ROUTE 1u  // OSRM found no route, the entry has no blob
+
+struct geometry_index_entry {
+    uint32_t from = 0;       // Location index of the origin
+    uint32_t to = 0;         // Location index of the destination
+    uint64_t offset = 0;     // Absolute file offset of the blob
+    uint32_t bytes = 0;      // Size of the blob
+    uint32_t status = GEOMETRY_NO_ROUTE;
+    double distance = 0.0;   // Route distance in meters
+    double duration = 0.0;   // Route duration in seconds
+};
+
+// One exported route as read back from a geometry file
+struct geometry_record {
+    geometry_index_entry entry;
+    std::string polyline;         // Encoded polyline, precision 1e6
+    std::vector<float> durations; // Per segment of the leg, empty without annotations
+    std::vector<float> distances;
+};
+
+// Read a pair list: one 'from to' pair of location indices per line, '#' starts a comment.
+// Pairs with an index outside [0, numberOfLocations) are reported and skipped.
+bool load_geometry_pairs(const std::string &filename, int numberOfLocations, std::vector<std::pair<int, int>> &pairs);
+
+// Streams route blobs to a geometry file. add() may be called concurrently from several threads.
+class GeometryFileWriter {
+public:
+    // Create the file for `count` pairs, blobs will hold annotations if `annotations` is set
+    bool open(const std::string &filename, uint64_t count, bool annotations);
+
+    // Append the route of pair `k` (its position in the pair list) and record it in the index
+    bool add(uint64_t k, uint32_t from, uint32_t to, double distance, double duration, const std::string &polyline,
+             const std::vector<float> &durations, const std::vector<float> &distances);
+
+    // Record pair `k` as not routable
+    void add_failed(uint64_t k, uint32_t from, uint32_t to);
+
+    // Write the index and the final header
+    bool close();
+
+private:
+    std::mutex mutex_;
+    std::ofstream out_;
+    geometry_file_header header_;
+    std::vector<geometry_index_entry> index_;
+    uint64_t position_ = 0;
+};
+
+// Random access to the routes of a geometry file
+class GeometryFileReader {
+public:
+    bool open(const std::string &filename);
+
+    const geometry_file_header &header() const { return header_; }
+    uint64_t size() const { return index_.size(); }
+    const geometry_index_entry &entry(uint64_t k) const { return index_[k]; }
+
+    // Read route k (position in the pair list), the polyline is empty for unroutable pairs
+    bool read(uint64_t k, geometry_record &record);
+
+private:
+    std::ifstream in_;
+    geometry_file_header header_;
+    std::vector<geometry_index_entry> index_;
+};
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+// std libs
+#include <string>
+#include <vector>
+
+// A batch job manifest lists many small matrix jobs that run in one process against the datasets loaded
+// once (--manifest). One job per line: "<coordinates file> <output directory>", whitespace separated,
+// '#' starts a comment. Relative paths are relative to the directory of the manifest.
+struct manifest_job {
+    std::string coordinates_path;
+    std::string output_dir;
+};
+
+// Read the jobs of `filename`. Invalid lines are reported and skipped; returns false if the file can't be
+// read or lists no job.
+bool load_manifest(const std::string &filename, std::vector<manifest_job> &jobs);
+
+#endif
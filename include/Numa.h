@@ -0,0 +1,28 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+// std libs
+#include <string>
+#include <vector>
+
+// One NUMA node of the host and the CPUs that belong to it
+struct numa_node {
+    int id = 0;
+    std::vector<int> cpus;
+};
+
+// NUMA nodes of the host from /sys/devices/system/node, restricted to the CPUs this process may run on.
+// Hosts without NUMA information (or other platforms) report a single node with all CPUs.
+std::vector<numa_node> detect_numa_nodes();
+
+// Parse a kernel CPU list such as '0-3,8,10-11'
+std::vector<int> parse_cpu_list(const std::string &list);
+
+// Restrict the calling thread to `cpus`. Returns false if pinning is not supported or failed.
+bool pin_current_thread(const std::vector<int> &cpus);
+
+// Spread `num_threads` workers over `nodes` in proportion to their CPU counts (every node used gets at
+// least one worker). Returns the node index of every worker, workers of a node are consecutive.
+std::vector<int> assign_threads_to_nodes(const std::vector<numa_node> &nodes, int num_threads);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef PLANNER_H
+#define PLANNER_H
+
+// std libs
+#include <cstddef>
+#include <string>
+
+// Helpers of the budget planner (--memory-limit, --deadline, --plan), which estimates the peak memory and
+// runtime of a run before any matrix is allocated and picks the matrix encoding and in-memory or sharded
+// execution to fit the budget.
+
+// Resident set size of this process in bytes, 0 where it can't be read (Linux /proc/self/statm)
+size_t current_rss_bytes();
+
+// Parse a memory size: a number with an optional K, M, G or T suffix (powers of 1024), plain numbers are MB.
+// Returns false if the text is not a positive size.
+bool parse_memory_size(const std::string &text, size_t &bytes);
+
+// Parse a duration: a number with an optional s, m or h suffix, plain numbers are seconds.
+// Returns false if the text is not a positive duration.
+bool parse_duration(const std::string &text, double &seconds);
+
+// Human readable size ("1.5 GB") and duration ("2 h 5 min")
+std::string format_bytes(double bytes);
+std::string format_duration(double seconds);
+
+// Smallest of 1, 2, 5, 10, 20, 50, ... whose `codes` steps cover `max_value`
+double round_unit(double max_value, double codes);
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef POLYGON_H
+#define POLYGON_H
+
+// std libs
+#include <string>
+#include <utility>
+#include <vector>
+
+// Closed ring of (longitude, latitude) vertices, the closing vertex may or may not be repeated
+using Ring = std::vector<std::pair<double, double>>;
+
+// Area made of one or more polygons, each polygon is an outer ring followed by its holes.
+// Containment uses the even-odd rule over all rings, which is exact for valid (non-overlapping)
+// GeoJSON (Multi)Polygons.
+struct MultiPolygon {
+    std::vector<std::vector<Ring>> polygons;
+
+    // Bounding box (lon, lat), updated by `update_bounds`
+    double lon_min = 0.0, lon_max = 0.0;
+    double lat_min = 0.0, lat_max = 0.0;
+
+    // Polygon edge (x = longitude, y = latitude) as used by the ray cast
+    struct Edge {
+        double x1, y1, x2, y2;
+    };
+
+    // Containment acceleration: the bounding box is cut into horizontal latitude bands and every band
+    // keeps the edges whose latitude range overlaps it. A ray cast then only visits the edges of one
+    // band instead of every vertex. Built by `update_bounds`.
+    std::vector<Edge> band_edges;          // edges of all bands, band b owns [band_offsets[b], band_offsets[b + 1])
+    std::vector<unsigned> band_offsets;
+    double band_scale = 0.0;               // number of bands per degree of latitude
+
+    bool empty() const { return polygons.empty(); }
+
+    // Total number of vertices over all rings
+    size_t vertex_count() const;
+
+    // Recompute the bounding box from the rings and rebuild the band index.
+    // Must be called after `polygons` changes.
+    void update_bounds();
+
+    // Ray-casting containment test over the edges of the band that contains `lat`
+    bool contains(double lon, double lat) const;
+
+    // Reference ray-casting containment test over every edge of every ring
+    bool contains_linear(double lon, double lat) const;
+};
+
+// Load a polygon area from a GeoJSON file. Accepts a FeatureCollection, a Feature or a bare geometry;
+// all Polygon and MultiPolygon geometries found are merged into `area`.
+// Returns false (and prints why) if the file can't be read or contains no polygon.
+bool load_geojson_polygon(const std::string &file, MultiPolygon &area);
+
+#endif
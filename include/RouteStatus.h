@@ -0,0 +1,109 @@
+#ifndef ROUTE_STATUS_H
+#define ROUTE_STATUS_H
+
+// std libs
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// How the travel time and distance of a cell were obtained
+enum route_status : uint8_t {
+    ROUTE_OK = 0,               // Routed by OSRM (or the diagonal)
+    ROUTE_SAME_PLACE = 1,       // Zero route between (nearly) the same place, fallback estimate
+    ROUTE_OUTSIDE_EXTRACT = 2,  // Zero route between different places, probably outside the OSM extract, fallback estimate
+    ROUTE_ERROR = 3,            // OSRM returned an error (e.g. no route), fallback estimate
+    ROUTE_STATUS_COUNT = 4
+};
+
+inline const char *route_status_name(int status) {
+    static const char *names[ROUTE_STATUS_COUNT] = {"ok", "same-place", "outside-extract", "error"};
+    return status >= 0 && status < ROUTE_STATUS_COUNT ? names[status] : "unknown";
+}
+
+// Fallback estimate for a cell OSRM could not route: distance = haversine * detour, time = distance / speed
+struct fallback_rule {
+    double detour = 1.5; // Road distance over straight line distance
+    double speed = 14.0; // Meters per second
+};
+
+// Fallback rules per failing route status
+struct fallback_policy {
+    fallback_rule same_place{1.5, 14.0};
+    fallback_rule outside_extract{1.5, 14.0};
+    fallback_rule error{2.0, 12.0};
+
+    const fallback_rule &rule(uint8_t status) const {
+        return status == ROUTE_SAME_PLACE ? same_place : status == ROUTE_OUTSIDE_EXTRACT ? outside_extract : error;
+    }
+
+    // Parse one '--fallback' rule of the form 'same-place|outside-extract|error=detour:speed'.
+    // Returns false if the rule is malformed.
+    bool parse(const std::string &arg) {
+        const auto eq = arg.find('=');
+        const auto colon = arg.find(':', eq == std::string::npos ? 0 : eq);
+        if (eq == std::string::npos || colon == std::string::npos) return false;
+
+        const std::string name = arg.substr(0, eq);
+        fallback_rule *target = name == "same-place" ? &same_place : name == "outside-extract" ? &outside_extract : name == "error" ? &error : nullptr;
+        if (!target) return false;
+        try {
+            const double detour = std::stod(arg.substr(eq + 1, colon - eq - 1));
+            const double speed = std::stod(arg.substr(colon + 1));
+            if (!(detour > 0.0) || !(speed > 0.0)) return false;
+            *target = {detour, speed};
+        }
+        catch (const std::exception &) {
+            return false;
+        }
+        return true;
+    }
+};
+
+// One status byte per cell, in the same layout as the travel matrices (square or packed upper triangle)
+class RouteStatusMatrix {
+public:
+    void allocate(int rows, int cols, bool triangle = false) {
+        rows_ = rows;
+        cols_ = cols;
+        triangle_ = triangle;
+        cells_.assign(triangle ? static_cast<size_t>(rows) * (rows + 1) / 2 : static_cast<size_t>(rows) * cols, ROUTE_OK);
+    }
+
+    int rows() const { return rows_; }
+    int cols() const { return cols_; }
+
+    void set(int i, int j, uint8_t status) { cells_[offset(i, j)] = status; }
+    uint8_t get(int i, int j) const { return cells_[offset(i, j)]; }
+
+    // Number of cells with every status; in a triangle the mirrored cells count twice
+    std::array<uint64_t, ROUTE_STATUS_COUNT> counts() const {
+        std::array<uint64_t, ROUTE_STATUS_COUNT> counts{};
+        for (int i = 0; i < rows_; ++i) {
+            for (int j = triangle_ ? i : 0; j < cols_; ++j) {
+                const uint8_t s = get(i, j);
+                counts[s < ROUTE_STATUS_COUNT ? s : static_cast<uint8_t>(ROUTE_ERROR)] += triangle_ && j != i ? 2 : 1;
+            }
+        }
+        return counts;
+    }
+
+private:
+    size_t offset(int i, int j) const {
+        if (triangle_) {
+            if (i > j) std::swap(i, j);
+            const size_t row = static_cast<size_t>(i);
+            return row * cols_ - row * (row - 1) / 2 + (j - i);
+        }
+        return static_cast<size_t>(i) * cols_ + j;
+    }
+
+    int rows_ = 0;
+    int cols_ = 0;
+    bool triangle_ = false;
+    std::vector<uint8_t> cells_;
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef TABLE_FILE_H
+#define TABLE_FILE_H
+
+// std libs
+#include <string>
+
+#include "Pipeline.h"
+#include "RouteStatus.h"
+#include "TravelMatrix.h"
+
+// Columnar matrix outputs for analytics tools (Spark, DuckDB, pandas, ...), written with Apache Arrow:
+//   arrow   : Arrow IPC stream (.arrows), readable batch by batch or memory-mapped
+//   parquet : Parquet file (.parquet), one row group per batch, zstd compressed when available
+// Two layouts:
+//   long : one record per cell, columns from, to (location indices), time (s), distance (m), status (route_status)
+//   wide : one record per origin, columns from, then one column per destination ("0", "1", ...); a file per matrix
+// Files are written in record batches of about TABLE_FILE_BATCH_CELLS cells, converted from the matrices
+// one batch at a time, so the output never needs a second copy of the matrix in memory. A batch is written
+// once `wait_row` says its rows are complete, so tables can be streamed while the matrix is still being routed.
+enum class TableFormat { Arrow, Parquet };
+enum class TableLayout { Long, Wide };
+
+#define TABLE_FILE_BATCH_CELLS (1u << 20)
+
+// Whether this build can write Arrow and Parquet files (Arrow found at configure time)
+bool table_file_available();
+
+// File extension of `format`, including the dot
+const char *table_file_extension(TableFormat format);
+
+// Write the times, distances and route status of every cell in the long layout. Rows are numbered from
+// `first_row` (the first origin of a row shard). Returns false on failure.
+bool write_matrix_table_long(const std::string &filename, TableFormat format, const TravelMatrix &times, const TravelMatrix &distances,
+                             const RouteStatusMatrix &status, int first_row = 0, const row_wait_fn &wait_row = {});
+
+// Write one matrix in the wide layout. Returns false on failure.
+bool write_matrix_table_wide(const std::string &filename, TableFormat format, const TravelMatrix &matrix, int first_row = 0,
+                             const row_wait_fn &wait_row = {});
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef TRAVEL_MATRIX_H
+#define TRAVEL_MATRIX_H
+
+// std libs
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// How the cells of a travel matrix are stored
+struct matrix_encoding {
+    int bits = 32;     // Bits per cell: 32, 24 or 16
+    double unit = 1.0; // Value of one stored step (seconds for times, meters for distances)
+};
+
+// Row-major rows x cols matrix of travel times or distances, quantised to `unit` steps and stored in
+// 16, 24 or 32 bits per cell. With the default encoding (32 bits, unit 1) a cell holds exactly the
+// int the matrices used to hold. Values are truncated to whole units; values above the largest
+// representable one are clamped and counted as overflows. Different cells never share bytes, so
+// threads may set distinct cells concurrently.
+// A square matrix can be allocated as a packed upper triangle (symmetric): only cells (i, j) with
+// i <= j are stored, row i holding columns i..n-1, and (j, i) reads and writes the same cell as (i, j).
+class TravelMatrix {
+public:
+    // Value returned by get() for cells that were never set
+    static constexpr int UNSET = INT32_MAX;
+
+    TravelMatrix() = default;
+    TravelMatrix(const TravelMatrix &) = delete;
+    TravelMatrix &operator=(const TravelMatrix &) = delete;
+
+    // Allocate the matrix, every cell starts unset. Returns false for an unsupported encoding
+    // or a non-square triangle.
+    bool allocate(int rows, int cols, const matrix_encoding &encoding, bool triangle = false) {
+        if (encoding.bits != 16 && encoding.bits != 24 && encoding.bits != 32) return false;
+        if (!(encoding.unit > 0.0)) return false;
+        if (triangle && rows != cols) return false;
+
+        rows_ = rows;
+        cols_ = cols;
+        triangle_ = triangle;
+        encoding_ = encoding;
+        cell_bytes_ = encoding.bits / 8;
+        // The largest code marks unset cells; for 32 bits it is INT32_MAX so a cell is a plain int
+        unset_code_ = encoding.bits == 32 ? static_cast<uint32_t>(INT32_MAX) : (1u << encoding.bits) - 1;
+        overflows_ = 0;
+
+        const size_t cells = triangle ? static_cast<size_t>(rows) * (rows + 1) / 2 : static_cast<size_t>(rows) * cols;
+        storage_.assign(cells * cell_bytes_, 0xFF);
+        if (encoding.bits == 32) {
+            for (size_t k = 0; k < storage_.size(); k += 4) store(k, unset_code_);
+        }
+        return true;
+    }
+
+    int rows() const { return rows_; }
+    int cols() const { return cols_; }
+    const matrix_encoding &encoding() const { return encoding_; }
+    bool triangle() const { return triangle_; }
+    uint32_t unset_code() const { return unset_code_; }
+
+    // Store `value` (seconds or meters) in cell (i, j)
+    void set(int i, int j, double value) {
+        store(offset(i, j), quantise(value));
+    }
+
+    // Value of cell (i, j) in seconds or meters, UNSET if it was never set
+    int get(int i, int j) const {
+        return dequantise(code(i, j));
+    }
+
+    bool is_set(int i, int j) const { return code(i, j) != unset_code_; }
+
+    // Dequantised copy of row i into `out` (cols() values)
+    void get_row(int i, int *out) const {
+        int j = 0;
+        if (triangle_) {
+            // Columns left of the diagonal live in the rows above
+            for (; j < i; ++j) out[j] = dequantise(load(offset(j, i)));
+        }
+        size_t k = offset(i, j);
+        for (; j < cols_; ++j, k += cell_bytes_) out[j] = dequantise(load(k));
+    }
+
+    // Raw stored code of cell (i, j)
+    uint32_t code(int i, int j) const { return load(offset(i, j)); }
+
+    // Raw storage: rows() * cols() cells (rows() * (rows() + 1) / 2 for a triangle, row by row)
+    // of encoding().bits / 8 little-endian bytes each
+    const uint8_t *data() const { return storage_.data(); }
+    size_t bytes() const { return storage_.size(); }
+
+    // Byte offset of the first stored cell of row i in data(), bytes() for i == rows()
+    size_t row_begin(int i) const { return i >= rows_ ? storage_.size() : offset(i, triangle_ ? i : 0); }
+
+    // Number of values that were clamped because they didn't fit the encoding
+    uint64_t overflow_count() const { return overflows_; }
+
+    // Largest value (seconds or meters) the encoding can hold
+    double max_value() const { return (unset_code_ - 1) * encoding_.unit; }
+
+    // Encode a value (seconds or meters) into a code, clamping (and counting) overflows
+    uint32_t quantise(double value) {
+        if (!(value > 0.0)) return 0;
+        const double steps = value / encoding_.unit;
+        if (steps >= static_cast<double>(unset_code_)) {
+            ++overflows_;
+            return unset_code_ - 1;
+        }
+        return static_cast<uint32_t>(steps);
+    }
+
+    int dequantise(uint32_t c) const {
+        if (c == unset_code_) return UNSET;
+        if (encoding_.unit == 1.0) return static_cast<int>(c);
+        return static_cast<int>(std::min(c * encoding_.unit, static_cast<double>(INT32_MAX - 1)));
+    }
+
+private:
+    size_t offset(int i, int j) const {
+        if (triangle_) {
+            if (i > j) std::swap(i, j);
+            const size_t row = static_cast<size_t>(i);
+            return (row * cols_ - row * (row - 1) / 2 + (j - i)) * cell_bytes_;
+        }
+        return (static_cast<size_t>(i) * cols_ + j) * cell_bytes_;
+    }
+
+    void store(size_t k, uint32_t c) {
+        switch (cell_bytes_) {
+        case 4: std::memcpy(&storage_[k], &c, 4); break;
+        case 2: { uint16_t v = static_cast<uint16_t>(c); std::memcpy(&storage_[k], &v, 2); break; }
+        default:
+            storage_[k] = static_cast<uint8_t>(c);
+            storage_[k + 1] = static_cast<uint8_t>(c >> 8);
+            storage_[k + 2] = static_cast<uint8_t>(c >> 16);
+        }
+    }
+
+    uint32_t load(size_t k) const {
+        switch (cell_bytes_) {
+        case 4: { uint32_t v; std::memcpy(&v, &storage_[k], 4); return v; }
+        case 2: { uint16_t v; std::memcpy(&v, &storage_[k], 2); return v; }
+        default:
+            return static_cast<uint32_t>(storage_[k]) | static_cast<uint32_t>(storage_[k + 1]) << 8 |
+                   static_cast<uint32_t>(storage_[k + 2]) << 16;
+        }
+    }
+
+    int rows_ = 0;
+    int cols_ = 0;
+    matrix_encoding encoding_;
+    int cell_bytes_ = 4;
+    bool triangle_ = false;
+    uint32_t unset_code_ = static_cast<uint32_t>(INT32_MAX);
+    std::vector<uint8_t> storage_;
+    std::atomic<uint64_t> overflows_{0};
+};
+
+#endif
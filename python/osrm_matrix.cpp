@@ -0,0 +1,99 @@
+// Python bindings of the osrm_matrix library (pybind11):
+//
+//     import numpy as np, osrm_matrix
+//     engine = osrm_matrix.MatrixEngine("region.osrm", algorithm="ch")
+//     times, distances = engine.table(np.array([[4.35, 50.85], [4.40, 51.22]]))
+//
+// The result matrices are NumPy arrays the engine writes into directly, and the GIL is released while
+// routing, so other Python threads keep running.
+
+// std libs
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include "MatrixEngine.h"
+
+namespace py = pybind11;
+
+namespace {
+
+using coordinate_array = py::array_t<double, py::array::c_style | py::array::forcecast>;
+
+// Check an (N, 2) lon/lat array and return N
+int coordinate_count(const coordinate_array &coordinates, const char *name) {
+    if (coordinates.ndim() != 2 || coordinates.shape(1) != 2) {
+        throw std::invalid_argument(std::string(name) + " must be an (N, 2) array of longitude, latitude");
+    }
+    return static_cast<int>(coordinates.shape(0));
+}
+
+py::tuple table(const MatrixEngine &engine, const coordinate_array &origins, py::object destinations, int threads, bool status) {
+    const int m = coordinate_count(origins, "origins");
+    // Without destinations, the square matrix of the origins
+    const coordinate_array targets = destinations.is_none() ? origins : destinations.cast<coordinate_array>();
+    const int n = coordinate_count(targets, "destinations");
+
+    py::array_t<int32_t> durations(std::vector<py::ssize_t>{m, n});
+    py::array_t<int32_t> distances(std::vector<py::ssize_t>{m, n});
+    py::array_t<uint8_t> statuses(status ? std::vector<py::ssize_t>{m, n} : std::vector<py::ssize_t>{0, 0});
+
+    // Raw pointers are taken while holding the GIL, the arrays stay referenced until we return
+    const double *origin_data = origins.data();
+    const double *target_data = targets.data();
+    int32_t *duration_data = durations.mutable_data();
+    int32_t *distance_data = distances.mutable_data();
+    uint8_t *status_data = status ? statuses.mutable_data() : nullptr;
+
+    bool ok;
+    {
+        py::gil_scoped_release release;
+        ok = engine.compute(origin_data, m, target_data, n, duration_data, distance_data, status_data, threads);
+    }
+    if (!ok) throw std::runtime_error("matrix computation failed");
+
+    if (status) return py::make_tuple(durations, distances, statuses);
+    return py::make_tuple(durations, distances);
+}
+
+} // namespace
+
+PYBIND11_MODULE(osrm_matrix, m) {
+    m.doc() = "In-process OSRM travel time and distance matrices";
+
+    py::class_<MatrixEngine>(m, "MatrixEngine")
+        .def(py::init([](const std::string &path, const std::string &algorithm, int threads) {
+                 if (algorithm != "ch" && algorithm != "mld") throw std::invalid_argument("algorithm must be 'ch' or 'mld'");
+                 auto engine = std::make_unique<MatrixEngine>();
+                 bool loaded;
+                 {
+                     py::gil_scoped_release release;
+                     loaded = engine->load(path, algorithm == "mld" ? osrm::EngineConfig::Algorithm::MLD : osrm::EngineConfig::Algorithm::CH);
+                 }
+                 if (!loaded) throw std::runtime_error("failed to load OSRM dataset " + path);
+                 engine->set_threads(threads);
+                 return engine;
+             }),
+             py::arg("path"), py::arg("algorithm") = "ch", py::arg("threads") = 0,
+             "Load the .osrm dataset at `path` (prepared for 'ch' or 'mld'); `threads` is the default worker count, 0 for one per CPU.")
+        .def("table", &table, py::arg("origins"), py::arg("destinations") = py::none(), py::arg("threads") = 0, py::arg("status") = false,
+             "Durations (s) and distances (m) from every origin to every destination as int32 (M, N) arrays. Coordinates are "
+             "(N, 2) arrays of longitude, latitude; without destinations the origins are used. With status=True a uint8 (M, N) "
+             "array of route statuses (0 ok, 1 same place, 2 outside extract, 3 error) is returned as third element.")
+        .def("set_fallback", [](MatrixEngine &engine, const std::vector<std::string> &rules) {
+                 // Tables running on other threads (GIL released) keep their policy snapshot, the new one is
+                 // swapped in atomically. The GIL serialises concurrent set_fallback calls.
+                 fallback_policy policy = engine.fallback();
+                 for (const auto &rule : rules) {
+                     if (!policy.parse(rule)) throw std::invalid_argument("invalid fallback rule '" + rule + "', use <status>=<detour>:<speed>");
+                 }
+                 engine.set_fallback(policy);
+             },
+             py::arg("rules"), "Fallback estimates of unroutable cells, e.g. ['error=2.0:12'] (same format as --fallback). Safe while "
+             "other threads compute tables: a running table keeps the policy it started with.");
+}
@@ -6,6 +6,7 @@
 #   ./run.sh -r belgium -c ./coordinates.txt
 #   ./run.sh -u https://download.geofabrik.de/europe/belgium-latest.osm.pbf -c ./coordinates.txt
 #   ./run.sh -r belgium            # no coords -> sampling mode
+#   ./run.sh -r belgium -p car,bicycle,foot -c ./coordinates.txt
 #
 # What it does:
 #   1. Resolves an .osm.pbf (downloads from Geofabrik if not already cached in ./OSM)
@@ -25,16 +26,20 @@ RESULTS_DIR="$(pwd)/results"
 REGION=""
 PBF_URL=""
 COORDS=""
+PROFILES="car"
 FORCE_BUILD=false
 
 usage() {
-  echo "Usage: $0 [-r region] [-u pbf_url] [-c coordinates.txt] [--force-build]"
+  echo "Usage: $0 [-r region] [-u pbf_url] [-c coordinates.txt] [-p profiles] [--force-build]"
   echo
   echo "  -r  Geofabrik region name, e.g. 'belgium', 'france', 'germany'"
   echo "      (resolves to https://download.geofabrik.de/europe/<region>-latest.osm.pbf)"
   echo "  -u  Direct URL to an .osm.pbf file (overrides -r)"
   echo "  -c  Path to a coordinates.txt file (longitude latitude per line)"
   echo "      If omitted, the app samples points inside the region."
+  echo "  -p  Comma separated OSRM profiles, e.g. 'car,bicycle,foot' (default: car)"
+  echo "      With several profiles the outputs are written to results/<profile>/."
+  echo "      Changing profiles requires --force-build."
   echo "  --force-build   Rebuild the docker image even if it already exists"
   exit 1
 }
@@ -44,6 +49,7 @@ while [[ $# -gt 0 ]]; do
     -r) REGION="$2"; shift 2 ;;
     -u) PBF_URL="$2"; shift 2 ;;
     -c) COORDS="$2"; shift 2 ;;
+    -p) PROFILES="${2//,/ }"; shift 2 ;;
     --force-build) FORCE_BUILD=true; shift ;;
     -h|--help) usage ;;
     *) echo "Unknown argument: $1"; usage ;;
@@ -111,7 +117,7 @@ if [[ -z "$IMAGE_EXISTS" || "$FORCE_BUILD" == true ]]; then
     mkdir -p "$DOCKER_DIR/OSM"
     cp "$PBF_FILE" "$DOCKER_DIR/OSM/region.osm.pbf"
   }
-  docker build "$DOCKER_DIR" -t "$IMAGE_NAME"
+  docker build "$DOCKER_DIR" -t "$IMAGE_NAME" --build-arg PROFILES="$PROFILES"
 else
   echo ">> Image $IMAGE_NAME already exists, skipping build (use --force-build to override)"
 fi
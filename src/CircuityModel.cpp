@@ -0,0 +1,92 @@
+// std libs
+#include <algorithm>
+#include <cmath>
+
+#include "CircuityModel.h"
+
+// ++++++++++++++++++++++++++++++++++++++ FUNCTIONS ++++++++++++++++++++++++++++++++++++++
+
+namespace {
+
+// Median of `values` (non-empty), reorders them
+double median(std::vector<double> &values) {
+    auto middle = values.begin() + values.size() / 2;
+    std::nth_element(values.begin(), middle, values.end());
+    return *middle;
+}
+
+} // namespace
+
+CircuityModel::CircuityModel(double **coordinates, int n, int grid) : lat_(n), lon_(n), cos_lat_(n), cell_(n, 0) {
+    grid = std::max(1, grid);
+    double min_lon = n > 0 ? coordinates[0][0] : 0, max_lon = min_lon, min_lat = n > 0 ? coordinates[0][1] : 0, max_lat = min_lat;
+    for (int i = 0; i < n; ++i) {
+        min_lon = std::min(min_lon, coordinates[i][0]);
+        max_lon = std::max(max_lon, coordinates[i][0]);
+        min_lat = std::min(min_lat, coordinates[i][1]);
+        max_lat = std::max(max_lat, coordinates[i][1]);
+    }
+    const double width = std::max(max_lon - min_lon, 1e-9), height = std::max(max_lat - min_lat, 1e-9);
+    for (int i = 0; i < n; ++i) {
+        lon_[i] = coordinates[i][0] * M_PI / 180.0;
+        lat_[i] = coordinates[i][1] * M_PI / 180.0;
+        cos_lat_[i] = std::cos(lat_[i]);
+        const int x = std::min(grid - 1, static_cast<int>((coordinates[i][0] - min_lon) / width * grid));
+        const int y = std::min(grid - 1, static_cast<int>((coordinates[i][1] - min_lat) / height * grid));
+        cell_[i] = y * grid + x;
+    }
+    cell_circuity_.assign(static_cast<size_t>(grid) * grid * CIRCUITY_BANDS, 0);
+    cell_pace_.assign(cell_circuity_.size(), 0);
+}
+
+int CircuityModel::band(double straight) {
+    return static_cast<int>(std::upper_bound(std::begin(CIRCUITY_BAND_EDGES), std::end(CIRCUITY_BAND_EDGES), straight) - std::begin(CIRCUITY_BAND_EDGES));
+}
+
+int CircuityModel::fit(const std::vector<circuity_sample> &samples) {
+    // Ratios per stratum, per band and overall. Pairs closer than a meter have no meaningful ratio.
+    std::vector<std::vector<double>> circuity(strata()), pace(strata()), band_circuity(CIRCUITY_BANDS), band_pace(CIRCUITY_BANDS);
+    std::vector<double> all_circuity, all_pace;
+    for (const auto &sample : samples) {
+        if (sample.straight < 1) continue;
+        const int k = stratum(sample.from, sample.straight);
+        const double c = sample.distance / sample.straight, p = sample.time / sample.straight;
+        circuity[k].push_back(c);
+        pace[k].push_back(p);
+        band_circuity[k % CIRCUITY_BANDS].push_back(c);
+        band_pace[k % CIRCUITY_BANDS].push_back(p);
+        all_circuity.push_back(c);
+        all_pace.push_back(p);
+    }
+    if (all_circuity.empty()) return -1;
+    median_circuity_ = median(all_circuity);
+    median_pace_ = median(all_pace);
+
+    // Bands without enough samples take the factors of the nearest band that has them, or the overall ones
+    std::vector<double> band_c(CIRCUITY_BANDS, median_circuity_), band_p(CIRCUITY_BANDS, median_pace_);
+    for (int b = 0; b < CIRCUITY_BANDS; ++b) {
+        for (int offset = 0; offset < CIRCUITY_BANDS; ++offset) {
+            const int near = b - offset >= 0 && band_circuity[b - offset].size() >= CIRCUITY_MIN_SAMPLES ? b - offset
+                             : b + offset < CIRCUITY_BANDS && band_circuity[b + offset].size() >= CIRCUITY_MIN_SAMPLES ? b + offset
+                                                                                                           : -1;
+            if (near < 0) continue;
+            band_c[b] = median(band_circuity[near]);
+            band_p[b] = median(band_pace[near]);
+            break;
+        }
+    }
+
+    int fitted = 0;
+    for (int k = 0; k < strata(); ++k) {
+        if (circuity[k].size() >= CIRCUITY_MIN_SAMPLES) {
+            cell_circuity_[k] = median(circuity[k]);
+            cell_pace_[k] = median(pace[k]);
+            ++fitted;
+        }
+        else {
+            cell_circuity_[k] = band_c[k % CIRCUITY_BANDS];
+            cell_pace_[k] = band_p[k % CIRCUITY_BANDS];
+        }
+    }
+    return fitted;
+}
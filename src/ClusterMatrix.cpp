@@ -0,0 +1,175 @@
+// std libs
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "ClusterMatrix.h"
+
+namespace fs = std::filesystem;
+
+// ++++++++++++++++++++++++++++++++++++++ FUNCTIONS ++++++++++++++++++++++++++++++++++++++
+
+namespace {
+
+// Assign the locations [first, last) to `k` clusters numbered from `next`: cut at the median of the wider
+// side of their bounding box, giving both halves a share of `k` proportional to their locations
+void split_cell(double **coordinates, std::vector<int>::iterator first, std::vector<int>::iterator last, int k, int &next,
+                location_clusters &clusters) {
+    const auto size = last - first;
+    if (k <= 1 || size <= 1) {
+        // Centroid: the member closest to the mean, a real location so it snaps like the others
+        double lon = 0, lat = 0;
+        for (auto it = first; it != last; ++it) {
+            lon += coordinates[*it][0];
+            lat += coordinates[*it][1];
+        }
+        lon /= size;
+        lat /= size;
+        const double scale = std::cos(lat * M_PI / 180.0);
+        int centroid = *first;
+        double best = -1;
+        for (auto it = first; it != last; ++it) {
+            const double dx = (coordinates[*it][0] - lon) * scale, dy = coordinates[*it][1] - lat;
+            if (best < 0 || dx * dx + dy * dy < best) {
+                best = dx * dx + dy * dy;
+                centroid = *it;
+            }
+            clusters.cluster[*it] = next;
+        }
+        clusters.centroid.push_back(centroid);
+        ++next;
+        return;
+    }
+
+    double min_lon = coordinates[*first][0], max_lon = min_lon, min_lat = coordinates[*first][1], max_lat = min_lat;
+    for (auto it = first; it != last; ++it) {
+        min_lon = std::min(min_lon, coordinates[*it][0]);
+        max_lon = std::max(max_lon, coordinates[*it][0]);
+        min_lat = std::min(min_lat, coordinates[*it][1]);
+        max_lat = std::max(max_lat, coordinates[*it][1]);
+    }
+    // A degree of longitude shrinks with the cosine of the latitude
+    const double width = (max_lon - min_lon) * std::cos((min_lat + max_lat) / 2 * M_PI / 180.0);
+    const int axis = width >= max_lat - min_lat ? 0 : 1;
+
+    const int k_left = k / 2;
+    const auto middle = first + size * k_left / k;
+    std::nth_element(first, middle, last, [&](int a, int b) { return coordinates[a][axis] < coordinates[b][axis]; });
+    split_cell(coordinates, first, middle, k_left, next, clusters);
+    split_cell(coordinates, middle, last, k - k_left, next, clusters);
+}
+
+bool write_values(const fs::path &file, const std::vector<int32_t> &values, size_t columns) {
+    std::ofstream out(file);
+    if (!out.is_open()) {
+        std::cerr << "Failed to open output file: " << file.string() << std::endl;
+        return false;
+    }
+    std::string line;
+    for (size_t i = 0; i < values.size(); i += columns) {
+        line.clear();
+        for (size_t j = 0; j < columns; ++j) {
+            if (j) line += ',';
+            line += std::to_string(values[i + j]);
+        }
+        line += '\n';
+        out << line;
+    }
+    return out.good();
+}
+
+// All comma separated values of `file`, appended row by row
+bool read_values(const fs::path &file, std::vector<int32_t> &values) {
+    std::ifstream in(file);
+    if (!in.is_open()) {
+        std::cerr << "Failed to open " << file.string() << std::endl;
+        return false;
+    }
+    values.clear();
+    std::string line;
+    for (int line_number = 1; std::getline(in, line); ++line_number) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        const char *first = line.data(), *last = line.data() + line.size();
+        while (first < last) {
+            int32_t value = 0;
+            const auto res = std::from_chars(first, last, value);
+            if (res.ec != std::errc() || (res.ptr < last && *res.ptr != ',')) {
+                std::cerr << "Malformed value in " << file.string() << " line " << line_number << std::endl;
+                return false;
+            }
+            values.push_back(value);
+            first = res.ptr < last ? res.ptr + 1 : last;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+location_clusters cluster_locations(double **coordinates, int n, int k) {
+    location_clusters clusters;
+    clusters.cluster.assign(n, 0);
+    if (n == 0) return clusters;
+    std::vector<int> order(n);
+    for (int i = 0; i < n; ++i) order[i] = i;
+    int next = 0;
+    split_cell(coordinates, order.begin(), order.end(), std::max(1, std::min(k, n)), next, clusters);
+    return clusters;
+}
+
+bool ClusterMatrix::write(const std::string &dir) const {
+    std::vector<int32_t> rows;
+    rows.reserve(static_cast<size_t>(locations()) * 5);
+    for (int i = 0; i < locations(); ++i) {
+        rows.insert(rows.end(), {clusters.cluster[i], out_time[i], out_distance[i], in_time[i], in_distance[i]});
+    }
+    try {
+        fs::create_directories(dir);
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Failed to create output directory: " << dir << " -> " << e.what() << std::endl;
+        return false;
+    }
+    const fs::path base(dir);
+    const std::vector<int32_t> centroids(clusters.centroid.begin(), clusters.centroid.end());
+    return write_values(base / "cluster_locations.csv", rows, 5) && write_values(base / "cluster_centroids.csv", centroids, 1) &&
+           write_values(base / "cluster_times.csv", centroid_time, std::max(1, size())) &&
+           write_values(base / "cluster_distances.csv", centroid_distance, std::max(1, size()));
+}
+
+bool ClusterMatrix::read(const std::string &dir) {
+    const fs::path base(dir);
+    std::vector<int32_t> rows, centroids;
+    if (!read_values(base / "cluster_locations.csv", rows) || !read_values(base / "cluster_centroids.csv", centroids) ||
+        !read_values(base / "cluster_times.csv", centroid_time) || !read_values(base / "cluster_distances.csv", centroid_distance)) {
+        return false;
+    }
+    const size_t k = centroids.size();
+    if (rows.size() % 5 != 0 || centroid_time.size() != k * k || centroid_distance.size() != k * k) {
+        std::cerr << "Inconsistent cluster matrix files in " << dir << std::endl;
+        return false;
+    }
+
+    const size_t n = rows.size() / 5;
+    clusters.cluster.resize(n);
+    clusters.centroid.assign(centroids.begin(), centroids.end());
+    out_time.resize(n);
+    out_distance.resize(n);
+    in_time.resize(n);
+    in_distance.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        clusters.cluster[i] = rows[5 * i];
+        if (clusters.cluster[i] < 0 || static_cast<size_t>(clusters.cluster[i]) >= k) {
+            std::cerr << "Location " << i << " has an invalid cluster in " << dir << std::endl;
+            return false;
+        }
+        out_time[i] = rows[5 * i + 1];
+        out_distance[i] = rows[5 * i + 2];
+        in_time[i] = rows[5 * i + 3];
+        in_distance[i] = rows[5 * i + 4];
+    }
+    return true;
+}
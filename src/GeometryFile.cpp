@@ -0,0 +1,190 @@
+// std libs
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "GeometryFile.h"
+
+// ++++++++++++++++++++++++++++++++++++++ FUNCTIONS ++++++++++++++++++++++++++++++++++++++
+
+namespace {
+
+template <typename T>
+inline void put(std::vector<uint8_t> &out, const T &value) {
+    const size_t at = out.size();
+    out.resize(at + sizeof(T));
+    std::memcpy(&out[at], &value, sizeof(T));
+}
+
+template <typename T>
+inline bool get(const std::vector<uint8_t> &in, size_t &at, T &value) {
+    if (at + sizeof(T) > in.size()) return false;
+    std::memcpy(&value, &in[at], sizeof(T));
+    at += sizeof(T);
+    return true;
+}
+
+} // namespace
+
+bool load_geometry_pairs(const std::string &filename, int numberOfLocations, std::vector<std::pair<int, int>> &pairs) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open geometry pair list: " << filename << std::endl;
+        return false;
+    }
+
+    pairs.clear();
+    std::string line;
+    int lineNumber = 0, skipped = 0;
+    while (std::getline(file, line)) {
+        ++lineNumber;
+        const auto comment = line.find('#');
+        if (comment != std::string::npos) line.erase(comment);
+        std::istringstream iss(line);
+        int from, to;
+        if (!(iss >> from)) continue; // blank line
+        if (!(iss >> to) || from < 0 || to < 0 || from >= numberOfLocations || to >= numberOfLocations) {
+            if (++skipped <= 10) std::cerr << "Skipping invalid pair on line " << lineNumber << " of " << filename << std::endl;
+            continue;
+        }
+        pairs.emplace_back(from, to);
+    }
+    if (skipped > 10) std::cerr << skipped << " invalid pairs skipped in " << filename << std::endl;
+    return true;
+}
+
+bool GeometryFileWriter::open(const std::string &filename, uint64_t count, bool annotations) {
+    try {
+        std::filesystem::path p(filename);
+        auto dir = p.parent_path();
+        if (!dir.empty() && !std::filesystem::exists(dir)) {
+            std::filesystem::create_directories(dir);
+        }
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Failed to create output directory for: " << filename << " -> " << e.what() << std::endl;
+        return false;
+    }
+
+    out_.open(filename, std::ios::binary);
+    if (!out_.is_open()) {
+        std::cerr << "Failed to open output file: " << filename << std::endl;
+        return false;
+    }
+
+    header_ = geometry_file_header();
+    header_.count = count;
+    header_.flags = annotations ? GEOMETRY_FILE_ANNOTATIONS : 0;
+    index_.assign(count, geometry_index_entry());
+
+    // Placeholder header, rewritten by close() once the index offset is known
+    out_.write(reinterpret_cast<const char *>(&header_), sizeof(header_));
+    position_ = sizeof(header_);
+    return out_.good();
+}
+
+bool GeometryFileWriter::add(uint64_t k, uint32_t from, uint32_t to, double distance, double duration, const std::string &polyline,
+                             const std::vector<float> &durations, const std::vector<float> &distances) {
+    // Encode outside the lock, only the append is serialised
+    std::vector<uint8_t> blob;
+    blob.reserve(2 * sizeof(uint32_t) + polyline.size() + (durations.size() + distances.size()) * sizeof(float));
+    put(blob, static_cast<uint32_t>(polyline.size()));
+    blob.insert(blob.end(), polyline.begin(), polyline.end());
+    if (header_.flags & GEOMETRY_FILE_ANNOTATIONS) {
+        const uint32_t segments = static_cast<uint32_t>(std::min(durations.size(), distances.size()));
+        put(blob, segments);
+        for (uint32_t s = 0; s < segments; ++s) put(blob, durations[s]);
+        for (uint32_t s = 0; s < segments; ++s) put(blob, distances[s]);
+    }
+
+    geometry_index_entry entry;
+    entry.from = from;
+    entry.to = to;
+    entry.bytes = static_cast<uint32_t>(blob.size());
+    entry.status = GEOMETRY_ROUTED;
+    entry.distance = distance;
+    entry.duration = duration;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    entry.offset = position_;
+    out_.write(reinterpret_cast<const char *>(blob.data()), blob.size());
+    position_ += blob.size();
+    index_[k] = entry;
+    return out_.good();
+}
+
+void GeometryFileWriter::add_failed(uint64_t k, uint32_t from, uint32_t to) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    index_[k].from = from;
+    index_[k].to = to;
+    index_[k].status = GEOMETRY_NO_ROUTE;
+}
+
+bool GeometryFileWriter::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    header_.index_offset = position_;
+    out_.write(reinterpret_cast<const char *>(index_.data()), index_.size() * sizeof(geometry_index_entry));
+    out_.seekp(0);
+    out_.write(reinterpret_cast<const char *>(&header_), sizeof(header_));
+    out_.close();
+    return !out_.fail();
+}
+
+bool GeometryFileReader::open(const std::string &filename) {
+    in_.open(filename, std::ios::binary);
+    if (!in_.is_open()) {
+        std::cerr << "Failed to open geometry file: " << filename << std::endl;
+        return false;
+    }
+
+    in_.read(reinterpret_cast<char *>(&header_), sizeof(header_));
+    const geometry_file_header expected;
+    if (!in_ || std::memcmp(header_.magic, expected.magic, sizeof(expected.magic)) != 0) {
+        std::cerr << "Not a geometry file: " << filename << std::endl;
+        return false;
+    }
+
+    index_.resize(header_.count);
+    in_.seekg(header_.index_offset);
+    in_.read(reinterpret_cast<char *>(index_.data()), index_.size() * sizeof(geometry_index_entry));
+    if (!in_) {
+        std::cerr << "Truncated geometry file: " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool GeometryFileReader::read(uint64_t k, geometry_record &record) {
+    if (k >= index_.size()) return false;
+    record.entry = index_[k];
+    record.polyline.clear();
+    record.durations.clear();
+    record.distances.clear();
+    if (record.entry.status != GEOMETRY_ROUTED) return true;
+
+    std::vector<uint8_t> blob(record.entry.bytes);
+    in_.seekg(record.entry.offset);
+    in_.read(reinterpret_cast<char *>(blob.data()), blob.size());
+    if (!in_) return false;
+
+    size_t at = 0;
+    uint32_t length = 0;
+    if (!get(blob, at, length) || at + length > blob.size()) return false;
+    record.polyline.assign(reinterpret_cast<const char *>(&blob[at]), length);
+    at += length;
+
+    if (header_.flags & GEOMETRY_FILE_ANNOTATIONS) {
+        uint32_t segments = 0;
+        if (!get(blob, at, segments)) return false;
+        record.durations.resize(segments);
+        record.distances.resize(segments);
+        for (auto &d : record.durations) if (!get(blob, at, d)) return false;
+        for (auto &d : record.distances) if (!get(blob, at, d)) return false;
+    }
+    return true;
+}
@@ -0,0 +1,46 @@
+// std libs
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "Manifest.h"
+
+namespace fs = std::filesystem;
+
+// ++++++++++++++++++++++++++++++++++++++ FUNCTIONS ++++++++++++++++++++++++++++++++++++++
+
+bool load_manifest(const std::string &filename, std::vector<manifest_job> &jobs) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open manifest: " << filename << std::endl;
+        return false;
+    }
+
+    const fs::path base = fs::path(filename).parent_path();
+    auto resolve = [&](const std::string &path) { return fs::path(path).is_absolute() ? path : (base / path).string(); };
+
+    jobs.clear();
+    std::string line;
+    int lineNumber = 0, skipped = 0;
+    while (std::getline(file, line)) {
+        ++lineNumber;
+        const auto comment = line.find('#');
+        if (comment != std::string::npos) line.erase(comment);
+        std::istringstream iss(line);
+        manifest_job job;
+        if (!(iss >> job.coordinates_path)) continue; // blank line
+        std::string rest;
+        if (!(iss >> job.output_dir) || (iss >> rest)) {
+            if (++skipped <= 10) std::cerr << "Skipping invalid job on line " << lineNumber << " of " << filename << std::endl;
+            continue;
+        }
+        jobs.push_back({resolve(job.coordinates_path), resolve(job.output_dir)});
+    }
+    if (skipped > 10) std::cerr << skipped << " invalid jobs skipped in " << filename << std::endl;
+    if (jobs.empty()) {
+        std::cerr << "No jobs in manifest: " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,164 @@
+// std libs
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <variant>
+#include <vector>
+
+#include "MatrixEngine.h"
+#include "Threads.h"
+
+// ********************************* LOCAL PARAMETERS ************************************
+// Define earth's radius for haversine distance
+#define EARTH_RADIUS 6371.0
+
+// ++++++++++++++++++++++++++++++++++++++ FUNCTIONS ++++++++++++++++++++++++++++++++++++++
+
+// Degrees transpormed into radians
+inline double degreesToRadians(const double &degrees) {
+    double res = degrees * M_PI / 180.0;
+    return res;
+}
+
+// Haversie travel calculation (vogelvlucht)
+double haversine(double lat1, double lon1, double lat2, double lon2) {
+    double Lat1 = degreesToRadians(lat1);
+    double Lon1 = degreesToRadians(lon1);
+    double Lat2 = degreesToRadians(lat2);
+    double Lon2 = degreesToRadians(lon2);
+
+    double dlon = Lon2 - Lon1;
+    double dlat = Lat2 - Lat1;
+
+    double a = pow(sin(dlat / 2), 2) + cos(Lat1) * cos(Lat2) * pow(sin(dlon / 2), 2);
+    double c = 2 * atan2(sqrt(a), sqrt(1 - a));
+
+    return EARTH_RADIUS * c * 1000; // Multiply by 1000 to get the result in meters
+}
+
+bool MatrixEngine::load(const std::string &path, osrm::EngineConfig::Algorithm algorithm) {
+    // Configure based on a .osrm base path, and no datasets in shared mem from osrm-datastore
+    config_.storage_config = {path};
+    config_.use_shared_memory = false;
+
+    // We support two routing speed up techniques:
+    // - Contraction Hierarchies (CH): requires extract+contract pre-processing
+    // - Multi-Level Dijkstra (MLD): requires extract+partition+customize pre-processing
+    config_.algorithm = algorithm;
+
+    try {
+        engine_ = std::make_unique<osrm::OSRM>(config_);
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Failed to load OSRM dataset " << path << " -> " << e.what() << std::endl;
+        engine_.reset();
+        return false;
+    }
+    return true;
+}
+
+uint8_t MatrixEngine::route(osrm::RouteParameters &params, const double *from, const double *to, DiagnosticLog &log, int &distance, int &time) const {
+    return route(params, from, to, log, *std::atomic_load(&fallback_), distance, time);
+}
+
+uint8_t MatrixEngine::route(osrm::RouteParameters &params, const double *from, const double *to, DiagnosticLog &log, const fallback_policy &policy,
+                            int &distance, int &time) const {
+    // Route
+    params.coordinates.clear();
+    params.coordinates.push_back({osrm::util::FloatLongitude{from[0]}, osrm::util::FloatLatitude{from[1]}});
+    params.coordinates.push_back({osrm::util::FloatLongitude{to[0]}, osrm::util::FloatLatitude{to[1]}});
+
+    // Response is in JSON format
+    osrm::engine::api::ResultT result = osrm::json::Object();
+
+    // Execute routing request, this does the heavy lifting
+    const auto status = engine_->Route(params, result);
+
+    // Haversine based estimate, only needed for the fallbacks
+    auto fallback = [&](uint8_t route_status) {
+        const fallback_rule &rule = policy.rule(route_status);
+        distance = static_cast<int>(haversine(from[1], from[0], to[1], to[0])) * rule.detour;
+        time = distance / rule.speed;
+        return route_status;
+    };
+
+    auto &json_result = std::get<osrm::json::Object>(result);
+    if (status == osrm::Status::Ok) {
+        auto &routes = std::get<osrm::json::Array>(json_result.values["routes"]);
+
+        // Let's just use the first route
+        auto &route = std::get<osrm::json::Object>(routes.values.at(0));
+        auto route_distance = std::get<osrm::json::Number>(route.values["distance"]).value;
+        auto route_time = std::get<osrm::json::Number>(route.values["duration"]).value;
+
+        // A zero route between different places means the extract does not contain the coordinates
+        if (route_distance == 0 || route_time == 0) {
+            if (static_cast<int>(from[0] * 100) == static_cast<int>(to[0] * 100) && static_cast<int>(from[1] * 100) == static_cast<int>(to[1] * 100)) {
+                return fallback(ROUTE_SAME_PLACE);
+            }
+            if (log.admit(ROUTE_OUTSIDE_EXTRACT)) {
+                std::ostringstream message;
+                message << "Note: distance or duration is zero, probably a query outside of the OSM extract: "
+                        << from[1] << ", " << from[0] << " -> " << to[1] << ", " << to[0];
+                log.write(message.str());
+            }
+            return fallback(ROUTE_OUTSIDE_EXTRACT);
+        }
+        distance = route_distance;
+        time = route_time;
+        return ROUTE_OK;
+    }
+
+    if (log.admit(ROUTE_ERROR)) {
+        std::ostringstream message;
+        message << "Route " << from[1] << ", " << from[0] << " -> " << to[1] << ", " << to[0] << " failed";
+        auto code = json_result.values.find("code");
+        auto text = json_result.values.find("message");
+        if (code != json_result.values.end() && std::holds_alternative<osrm::json::String>(code->second)) message << ", code: " << std::get<osrm::json::String>(code->second).value;
+        if (text != json_result.values.end() && std::holds_alternative<osrm::json::String>(text->second)) message << ", message: " << std::get<osrm::json::String>(text->second).value;
+        log.write(message.str());
+    }
+    return fallback(ROUTE_ERROR);
+}
+
+bool MatrixEngine::compute(const double *origins, int m, const double *destinations, int n, int32_t *durations, int32_t *distances,
+                           uint8_t *status, int threads) const {
+    if (!engine_ || m < 0 || n < 0 || (m > 0 && !origins) || (n > 0 && !destinations)) return false;
+    const int64_t number_of_pairs = static_cast<int64_t>(m) * n;
+    if (number_of_pairs == 0) return true;
+
+    const int default_threads = threads_;
+    int num_threads = threads > 0 ? threads : default_threads > 0 ? default_threads : available_cpus();
+    num_threads = static_cast<int>(std::max<int64_t>(1, std::min<int64_t>(num_threads, number_of_pairs)));
+
+    // Library callers read the statuses, nothing is written to std::cerr. One policy for the whole matrix.
+    DiagnosticLog log(ROUTE_STATUS_COUNT, 0);
+    const std::shared_ptr<const fallback_policy> policy = std::atomic_load(&fallback_);
+    const int64_t payload_size = (number_of_pairs + num_threads - 1) / num_threads;
+    auto proc = [&](int64_t start_i, int64_t end_i) {
+        osrm::RouteParameters params;
+        params.overview = osrm::RouteParameters::OverviewType::False;
+        for (int64_t k = start_i; k < end_i; ++k) {
+            const double *from = origins + 2 * (k / n);
+            const double *to = destinations + 2 * (k % n);
+            int distance = 0, time = 0;
+            const uint8_t route_status = route(params, from, to, log, *policy, distance, time);
+            if (durations) durations[k] = time;
+            if (distances) distances[k] = distance;
+            if (status) status[k] = route_status;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int t = 1; t < num_threads; ++t) {
+        workers.emplace_back(proc, t * payload_size, std::min(number_of_pairs, (t + 1) * payload_size));
+    }
+    // The calling thread takes the first block
+    proc(0, std::min(number_of_pairs, payload_size));
+    for (auto &w : workers) {
+        w.join();
+    }
+    return true;
+}
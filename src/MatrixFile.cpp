@@ -0,0 +1,316 @@
+// std libs
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef OSRM_OUTPUT_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "MatrixFile.h"
+
+// ********************************* LOCAL PARAMETERS ************************************
+// Rows per compressed block, the unit of random access in compressed files
+#define MATRIX_FILE_BLOCK_ROWS 64
+// zstd compression level
+#define MATRIX_FILE_ZSTD_LEVEL 3
+
+// ++++++++++++++++++++++++++++++++++++++ FUNCTIONS ++++++++++++++++++++++++++++++++++++++
+
+namespace {
+
+inline void put_varint(std::vector<uint8_t> &out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<uint8_t>(v) | 0x80);
+        v >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+inline bool get_varint(const uint8_t *&p, const uint8_t *end, uint64_t &v) {
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        const uint8_t byte = *p++;
+        v |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+inline uint64_t zigzag(int64_t v) { return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63); }
+inline int64_t unzigzag(uint64_t v) { return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1); }
+
+inline int dequantise(uint32_t code, const matrix_file_header &header, uint32_t unset_code) {
+    if (code == unset_code) return TravelMatrix::UNSET;
+    return static_cast<int>(std::min(code * header.unit, static_cast<double>(INT32_MAX - 1)));
+}
+
+inline uint32_t unset_code_for(uint32_t bits) {
+    return bits == 32 ? static_cast<uint32_t>(INT32_MAX) : (1u << bits) - 1;
+}
+
+} // namespace
+
+bool matrix_file_compression_available() {
+#ifdef OSRM_OUTPUT_HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool write_matrix_file(const std::string &filename, const TravelMatrix &matrix, bool compressed, const row_wait_fn &wait_row) {
+#ifndef OSRM_OUTPUT_HAVE_ZSTD
+    if (compressed) {
+        std::cerr << "Compressed matrix output requested but this build has no zstd support." << std::endl;
+        return false;
+    }
+#endif
+    try {
+        std::filesystem::path p(filename);
+        auto dir = p.parent_path();
+        if (!dir.empty() && !std::filesystem::exists(dir)) {
+            std::filesystem::create_directories(dir);
+        }
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Failed to create output directory for: " << filename << " -> " << e.what() << std::endl;
+        return false;
+    }
+
+    std::ofstream out(filename, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "Failed to open output file: " << filename << std::endl;
+        return false;
+    }
+
+    matrix_file_header header;
+    header.rows = matrix.rows();
+    header.cols = matrix.cols();
+    header.bits = matrix.encoding().bits;
+    header.unit = matrix.encoding().unit;
+    header.flags = (compressed ? MATRIX_FILE_COMPRESSED : 0) | (matrix.triangle() ? MATRIX_FILE_TRIANGLE : 0);
+    header.block_rows = compressed ? MATRIX_FILE_BLOCK_ROWS : 0;
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    if (!compressed) {
+        if (!wait_row) {
+            out.write(reinterpret_cast<const char *>(matrix.data()), matrix.bytes());
+            return out.good();
+        }
+        // Stream the rows in blocks as they complete
+        for (int first = 0; first < matrix.rows(); first += MATRIX_FILE_BLOCK_ROWS) {
+            const int last = std::min(matrix.rows(), first + MATRIX_FILE_BLOCK_ROWS);
+            wait_row(last - 1);
+            out.write(reinterpret_cast<const char *>(matrix.data() + matrix.row_begin(first)), matrix.row_begin(last) - matrix.row_begin(first));
+        }
+        return out.good();
+    }
+
+#ifdef OSRM_OUTPUT_HAVE_ZSTD
+    const int rows = matrix.rows(), cols = matrix.cols();
+    const uint32_t blocks = (rows + MATRIX_FILE_BLOCK_ROWS - 1) / MATRIX_FILE_BLOCK_ROWS;
+
+    // Reserve the offset table, it is filled in once all blocks are written
+    std::vector<uint64_t> offsets(blocks + 1, 0);
+    const auto table_pos = out.tellp();
+    out.write(reinterpret_cast<const char *>(offsets.data()), offsets.size() * sizeof(uint64_t));
+
+    std::vector<uint8_t> raw;
+    std::vector<uint8_t> packed;
+    std::vector<uint32_t> previous(cols);
+    for (uint32_t b = 0; b < blocks; ++b) {
+        raw.clear();
+        std::fill(previous.begin(), previous.end(), 0);
+        if (wait_row) wait_row(std::min<int>(rows, (b + 1) * MATRIX_FILE_BLOCK_ROWS) - 1);
+        for (int i = b * MATRIX_FILE_BLOCK_ROWS; i < std::min<int>(rows, (b + 1) * MATRIX_FILE_BLOCK_ROWS); ++i) {
+            for (int j = matrix.triangle() ? i : 0; j < cols; ++j) {
+                const uint32_t code = matrix.code(i, j);
+                put_varint(raw, zigzag(static_cast<int64_t>(code) - previous[j]));
+                previous[j] = code;
+            }
+        }
+
+        packed.resize(ZSTD_compressBound(raw.size()));
+        const size_t size = ZSTD_compress(packed.data(), packed.size(), raw.data(), raw.size(), MATRIX_FILE_ZSTD_LEVEL);
+        if (ZSTD_isError(size)) {
+            std::cerr << "zstd compression failed: " << ZSTD_getErrorName(size) << std::endl;
+            return false;
+        }
+        out.write(reinterpret_cast<const char *>(packed.data()), size);
+        offsets[b + 1] = offsets[b] + size;
+    }
+
+    out.seekp(table_pos);
+    out.write(reinterpret_cast<const char *>(offsets.data()), offsets.size() * sizeof(uint64_t));
+    return out.good();
+#else
+    return false;
+#endif
+}
+
+bool MatrixFileReader::open(const std::string &filename) {
+    in_.open(filename, std::ios::binary);
+    if (!in_.is_open()) {
+        std::cerr << "Failed to open matrix file: " << filename << std::endl;
+        return false;
+    }
+
+    in_.seekg(0, std::ios::end);
+    const uint64_t file_size = static_cast<uint64_t>(in_.tellg());
+    in_.seekg(0);
+    in_.read(reinterpret_cast<char *>(&header_), sizeof(header_));
+    const matrix_file_header expected;
+    if (!in_ || std::memcmp(header_.magic, expected.magic, sizeof(expected.magic)) != 0) {
+        std::cerr << "Not a matrix file: " << filename << std::endl;
+        return false;
+    }
+    if (header_.bits != 16 && header_.bits != 24 && header_.bits != 32) {
+        std::cerr << "Unsupported cell width " << header_.bits << " in matrix file: " << filename << std::endl;
+        return false;
+    }
+    if ((header_.flags & MATRIX_FILE_TRIANGLE) && header_.rows != header_.cols) {
+        std::cerr << "Triangle of a non-square matrix in matrix file: " << filename << std::endl;
+        return false;
+    }
+
+    if (header_.flags & MATRIX_FILE_COMPRESSED) {
+#ifndef OSRM_OUTPUT_HAVE_ZSTD
+        std::cerr << "Compressed matrix file but this build has no zstd support: " << filename << std::endl;
+        return false;
+#else
+        if (header_.block_rows == 0) {
+            std::cerr << "Invalid block size in matrix file: " << filename << std::endl;
+            return false;
+        }
+        const uint64_t blocks = (static_cast<uint64_t>(header_.rows) + header_.block_rows - 1) / header_.block_rows;
+        if (sizeof(header_) + (blocks + 1) * sizeof(uint64_t) > file_size) {
+            std::cerr << "Truncated block offsets in matrix file: " << filename << std::endl;
+            return false;
+        }
+        offsets_.resize(blocks + 1);
+        in_.read(reinterpret_cast<char *>(offsets_.data()), offsets_.size() * sizeof(uint64_t));
+        if (!in_) {
+            std::cerr << "Truncated block offsets in matrix file: " << filename << std::endl;
+            return false;
+        }
+#endif
+    }
+    data_start_ = static_cast<uint64_t>(in_.tellg());
+
+    // The blocks must follow each other and end within the file
+    if (header_.flags & MATRIX_FILE_COMPRESSED) {
+        bool valid = offsets_.front() == 0 && data_start_ + offsets_.back() <= file_size;
+        for (size_t b = 0; valid && b + 1 < offsets_.size(); ++b) valid = offsets_[b] <= offsets_[b + 1];
+        if (!valid) {
+            std::cerr << "Corrupt block offsets in matrix file: " << filename << std::endl;
+            return false;
+        }
+    }
+    cached_block_ = -1;
+    return true;
+}
+
+bool MatrixFileReader::load_block(uint32_t block) {
+#ifdef OSRM_OUTPUT_HAVE_ZSTD
+    if (cached_block_ == static_cast<int64_t>(block)) return true;
+
+    const uint64_t size = offsets_[block + 1] - offsets_[block];
+    std::vector<uint8_t> packed(size);
+    in_.seekg(data_start_ + offsets_[block]);
+    in_.read(reinterpret_cast<char *>(packed.data()), size);
+    if (!in_) return false;
+
+    const unsigned long long raw_size = ZSTD_getFrameContentSize(packed.data(), size);
+    if (raw_size == ZSTD_CONTENTSIZE_ERROR || raw_size == ZSTD_CONTENTSIZE_UNKNOWN) return false;
+    // A delta of 32 bit codes is at most a 5 byte varint, a larger frame is corrupt
+    if (raw_size > static_cast<uint64_t>(header_.block_rows) * header_.cols * 5) return false;
+    std::vector<uint8_t> raw(raw_size);
+    if (ZSTD_isError(ZSTD_decompress(raw.data(), raw.size(), packed.data(), size))) return false;
+
+    const uint32_t first_row = block * header_.block_rows;
+    const uint32_t num_rows = std::min(header_.block_rows, header_.rows - first_row);
+    block_starts_.assign(num_rows + 1, 0);
+    for (uint32_t r = 0; r < num_rows; ++r) block_starts_[r + 1] = block_starts_[r] + stored_cols(first_row + r);
+    block_codes_.assign(block_starts_.back(), 0);
+
+    // Deltas are taken per column against the row above, in a triangle that row starts one column earlier
+    const uint8_t *p = raw.data();
+    const uint8_t *end = raw.data() + raw.size();
+    for (uint32_t r = 0; r < num_rows; ++r) {
+        const uint32_t first_col = header_.cols - stored_cols(first_row + r);
+        for (uint32_t j = first_col; j < header_.cols; ++j) {
+            uint64_t v;
+            if (!get_varint(p, end, v)) return false;
+            const int64_t previous = r == 0 ? 0 : block_codes_[block_starts_[r - 1] + j - (header_.cols - stored_cols(first_row + r - 1))];
+            block_codes_[block_starts_[r] + j - first_col] = static_cast<uint32_t>(previous + unzigzag(v));
+        }
+    }
+    cached_block_ = block;
+    return true;
+#else
+    (void)block;
+    return false;
+#endif
+}
+
+bool MatrixFileReader::stored_code(uint32_t i, uint32_t j, uint32_t &code) {
+    const uint32_t first_col = header_.cols - stored_cols(i);
+    if (header_.flags & MATRIX_FILE_COMPRESSED) {
+        const uint32_t block = i / header_.block_rows;
+        if (!load_block(block)) return false;
+        code = block_codes_[block_starts_[i - block * header_.block_rows] + j - first_col];
+        return true;
+    }
+
+    // Raw rows are stored back to back
+    const uint32_t cell_bytes = header_.bits / 8;
+    uint64_t cell = static_cast<uint64_t>(i) * header_.cols + j;
+    if (header_.flags & MATRIX_FILE_TRIANGLE) cell = static_cast<uint64_t>(i) * header_.cols - static_cast<uint64_t>(i) * (i - 1) / 2 + (j - i);
+    code = 0;
+    in_.seekg(data_start_ + cell * cell_bytes);
+    in_.read(reinterpret_cast<char *>(&code), cell_bytes); // little-endian hosts
+    return static_cast<bool>(in_);
+}
+
+bool MatrixFileReader::read_row(int i, std::vector<int> &row) {
+    if (i < 0 || i >= rows()) return false;
+    row.resize(header_.cols);
+    const uint32_t unset_code = unset_code_for(header_.bits);
+
+    // Triangle: the columns left of the diagonal are stored in the rows above
+    uint32_t j = 0;
+    if (header_.flags & MATRIX_FILE_TRIANGLE) {
+        for (; j < static_cast<uint32_t>(i); ++j) {
+            uint32_t code;
+            if (!stored_code(j, i, code)) return false;
+            row[j] = dequantise(code, header_, unset_code);
+        }
+    }
+
+    if (header_.flags & MATRIX_FILE_COMPRESSED) {
+        const uint32_t block = i / header_.block_rows;
+        if (!load_block(block)) return false;
+        const uint32_t *codes = &block_codes_[block_starts_[i - block * header_.block_rows]];
+        for (uint32_t k = 0; j < header_.cols; ++j, ++k) row[j] = dequantise(codes[k], header_, unset_code);
+        return true;
+    }
+
+    const uint32_t cell_bytes = header_.bits / 8;
+    std::vector<uint8_t> bytes(static_cast<size_t>(header_.cols - j) * cell_bytes);
+    uint64_t first_cell = static_cast<uint64_t>(i) * header_.cols;
+    if (header_.flags & MATRIX_FILE_TRIANGLE) first_cell = static_cast<uint64_t>(i) * header_.cols - static_cast<uint64_t>(i) * (i - 1) / 2;
+    in_.seekg(data_start_ + first_cell * cell_bytes);
+    in_.read(reinterpret_cast<char *>(bytes.data()), bytes.size());
+    if (!in_) return false;
+    for (uint32_t k = 0; j < header_.cols; ++j, ++k) {
+        uint32_t code = 0;
+        std::memcpy(&code, &bytes[k * cell_bytes], cell_bytes); // little-endian hosts
+        row[j] = dequantise(code, header_, unset_code);
+    }
+    return true;
+}
@@ -0,0 +1,116 @@
+// std libs
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "PerfCounters.h"
+
+// ++++++++++++++++++++++++++++++++++++++ FUNCTIONS ++++++++++++++++++++++++++++++++++++++
+
+namespace {
+
+const char *counter_names[PERF_COUNTER_COUNT] = {"instructions", "cycles", "cache misses", "dTLB misses"};
+
+#ifdef __linux__
+
+// Open counter `counter` of the calling thread, disabled. Returns -1 and sets errno on failure.
+int open_counter(int counter) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    switch (counter) {
+    case PERF_INSTRUCTIONS:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case PERF_CYCLES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case PERF_CACHE_MISSES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES; // Last level cache on most CPUs
+        break;
+    default:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    }
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // The kernel multiplexes counters when there are more than registers, the times allow scaling
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+#endif
+
+} // namespace
+
+void perf_totals::report(const std::string &stage) const {
+    bool any = false;
+    for (int c = 0; c < PERF_COUNTER_COUNT; ++c) any = any || threads[c] > 0;
+    if (!any) {
+        std::cout << " - Counters " << stage << ": unavailable";
+        if (error != 0) std::cout << " (perf_event_open: " << std::strerror(error) << ", see /proc/sys/kernel/perf_event_paranoid)";
+        std::cout << std::endl;
+        return;
+    }
+    const double per = cells > 0 ? 1.0 / cells : 0.0;
+    std::cout << std::fixed << std::setprecision(1) << " - Counters " << stage << " (" << cells << " cells), per cell:";
+    for (int c = 0; c < PERF_COUNTER_COUNT; ++c) {
+        if (threads[c] > 0) std::cout << " " << counter_names[c] << " " << value[c] * per;
+        else std::cout << " " << counter_names[c] << " n/a";
+        if (c + 1 < PERF_COUNTER_COUNT) std::cout << ",";
+    }
+    if (threads[PERF_INSTRUCTIONS] > 0 && threads[PERF_CYCLES] > 0 && value[PERF_CYCLES] > 0) {
+        std::cout << std::setprecision(2) << " (IPC " << static_cast<double>(value[PERF_INSTRUCTIONS]) / value[PERF_CYCLES] << ")";
+    }
+    std::cout << std::defaultfloat << std::endl;
+}
+
+thread_counters::thread_counters(perf_totals *totals) : totals_(totals) {
+    for (int c = 0; c < PERF_COUNTER_COUNT; ++c) fd_[c] = -1;
+    if (!totals_) return;
+#ifdef __linux__
+    for (int c = 0; c < PERF_COUNTER_COUNT; ++c) {
+        fd_[c] = open_counter(c);
+        if (fd_[c] < 0) {
+            int none = 0;
+            totals_->error.compare_exchange_strong(none, errno);
+        }
+    }
+    for (int c = 0; c < PERF_COUNTER_COUNT; ++c) {
+        if (fd_[c] >= 0) ioctl(fd_[c], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#else
+    totals_->error.store(ENOSYS);
+#endif
+}
+
+thread_counters::~thread_counters() {
+#ifdef __linux__
+    for (int c = 0; c < PERF_COUNTER_COUNT; ++c) {
+        if (fd_[c] >= 0) ioctl(fd_[c], PERF_EVENT_IOC_DISABLE, 0);
+    }
+    for (int c = 0; c < PERF_COUNTER_COUNT; ++c) {
+        if (fd_[c] < 0) continue;
+        uint64_t data[3] = {0, 0, 0}; // value, time enabled, time running
+        if (read(fd_[c], data, sizeof(data)) == static_cast<ssize_t>(sizeof(data)) && data[2] > 0) {
+            const double scale = static_cast<double>(data[1]) / data[2];
+            totals_->value[c] += static_cast<int64_t>(data[0] * scale);
+            ++totals_->threads[c];
+        }
+        close(fd_[c]);
+    }
+#endif
+}
@@ -0,0 +1,95 @@
+// std libs
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+#include "Planner.h"
+
+// ++++++++++++++++++++++++++++++++++++++ FUNCTIONS ++++++++++++++++++++++++++++++++++++++
+
+size_t current_rss_bytes() {
+#ifdef __linux__
+    // statm: total and resident pages
+    std::ifstream file("/proc/self/statm");
+    size_t total = 0, resident = 0;
+    if (file >> total >> resident) return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+    return 0;
+}
+
+namespace {
+
+// Number followed by an optional one letter suffix
+bool split_suffix(const std::string &text, double &value, char &suffix) {
+    std::istringstream in(text);
+    suffix = 0;
+    if (!(in >> value)) return false;
+    in >> suffix;
+    std::string rest;
+    return !(in >> rest) && value > 0;
+}
+
+} // namespace
+
+bool parse_memory_size(const std::string &text, size_t &bytes) {
+    double value = 0;
+    char suffix = 0;
+    if (!split_suffix(text, value, suffix)) return false;
+    double scale = 1024.0 * 1024.0;
+    switch (suffix) {
+        case 'K': case 'k': scale = 1024.0; break;
+        case 0: case 'M': case 'm': break;
+        case 'G': case 'g': scale = 1024.0 * 1024.0 * 1024.0; break;
+        case 'T': case 't': scale = 1024.0 * 1024.0 * 1024.0 * 1024.0; break;
+        default: return false;
+    }
+    bytes = static_cast<size_t>(value * scale);
+    return true;
+}
+
+bool parse_duration(const std::string &text, double &seconds) {
+    double value = 0;
+    char suffix = 0;
+    if (!split_suffix(text, value, suffix)) return false;
+    switch (suffix) {
+        case 0: case 's': seconds = value; break;
+        case 'm': seconds = value * 60; break;
+        case 'h': seconds = value * 3600; break;
+        default: return false;
+    }
+    return true;
+}
+
+std::string format_bytes(double bytes) {
+    const char *units[] = {"B", "KB", "MB", "GB", "TB"};
+    int u = 0;
+    while (bytes >= 1024 && u < 4) {
+        bytes /= 1024;
+        ++u;
+    }
+    char text[32];
+    std::snprintf(text, sizeof(text), u == 0 ? "%.0f %s" : "%.1f %s", bytes, units[u]);
+    return text;
+}
+
+std::string format_duration(double seconds) {
+    char text[48];
+    if (seconds < 60) std::snprintf(text, sizeof(text), "%.1f s", seconds);
+    else if (seconds < 3600) std::snprintf(text, sizeof(text), "%.0f min %.0f s", std::floor(seconds / 60), std::fmod(seconds, 60));
+    else std::snprintf(text, sizeof(text), "%.0f h %.0f min", std::floor(seconds / 3600), std::floor(std::fmod(seconds, 3600) / 60));
+    return text;
+}
+
+double round_unit(double max_value, double codes) {
+    if (!std::isfinite(max_value) || !(codes > 0) || max_value <= codes) return 1;
+    for (double unit = 1;; unit *= 10) {
+        for (double step : {1.0, 2.0, 5.0}) {
+            if (unit * step * codes >= max_value) return unit * step;
+        }
+    }
+}
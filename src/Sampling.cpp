@@ -0,0 +1,121 @@
+// std libs
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Sampling.h"
+
+// ********************************* LOCAL PARAMETERS ************************************
+// Number of candidates drawn per RNG block
+#define SAMPLE_BLOCK_SIZE 4096
+// Two points closer than this (in degrees, in both coordinates) are considered duplicates
+#define SAMPLE_DUPLICATE_EPSILON 1e-6
+
+// ++++++++++++++++++++++++++++++++++++++ FUNCTIONS ++++++++++++++++++++++++++++++++++++++
+
+namespace {
+
+// Grid hash with cell size equal to the duplicate epsilon: a near-duplicate of a point
+// always lies in the same or one of the 8 neighbouring cells.
+struct SpatialHash {
+    std::unordered_map<uint64_t, std::vector<int>> cells;
+    const std::vector<std::pair<double, double>> &points;
+
+    explicit SpatialHash(const std::vector<std::pair<double, double>> &points) : points(points) {}
+
+    static int64_t cell(double v) { return static_cast<int64_t>(std::floor(v / SAMPLE_DUPLICATE_EPSILON)); }
+
+    static uint64_t key(int64_t cx, int64_t cy) {
+        return static_cast<uint64_t>(cx) * 0x9E3779B97F4A7C15ULL ^ static_cast<uint64_t>(cy);
+    }
+
+    bool has_near(double lon, double lat) const {
+        const int64_t cx = cell(lon), cy = cell(lat);
+        for (int64_t dx = -1; dx <= 1; ++dx) {
+            for (int64_t dy = -1; dy <= 1; ++dy) {
+                auto it = cells.find(key(cx + dx, cy + dy));
+                if (it == cells.end()) continue;
+                for (int idx : it->second) {
+                    if (std::abs(points[idx].first - lon) < SAMPLE_DUPLICATE_EPSILON &&
+                        std::abs(points[idx].second - lat) < SAMPLE_DUPLICATE_EPSILON) return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void insert(int idx) {
+        cells[key(cell(points[idx].first), cell(points[idx].second))].push_back(idx);
+    }
+};
+
+// Draw one block of candidates and keep those inside the area
+void sample_block(const MultiPolygon &area, uint64_t seed, uint64_t block, std::vector<std::pair<double, double>> &out) {
+    std::seed_seq seq{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32),
+                      static_cast<uint32_t>(block), static_cast<uint32_t>(block >> 32)};
+    std::mt19937_64 rng(seq);
+    std::uniform_real_distribution<double> lon_dist(area.lon_min, area.lon_max);
+    std::uniform_real_distribution<double> lat_dist(area.lat_min, area.lat_max);
+
+    out.clear();
+    for (int i = 0; i < SAMPLE_BLOCK_SIZE; ++i) {
+        double lon = lon_dist(rng);
+        double lat = lat_dist(rng);
+        if (area.contains(lon, lat)) out.emplace_back(lon, lat);
+    }
+}
+
+} // namespace
+
+uint64_t sample_points_in_area(const MultiPolygon &area, int count, uint64_t seed, int num_threads,
+                               std::vector<std::pair<double, double>> &points) {
+    points.clear();
+    if (count <= 0 || area.empty()) return 0;
+
+    num_threads = std::max(1, num_threads);
+    const uint64_t max_attempts = std::max<uint64_t>(10000, static_cast<uint64_t>(count) * 1000);
+    const uint64_t max_blocks = (max_attempts + SAMPLE_BLOCK_SIZE - 1) / SAMPLE_BLOCK_SIZE;
+
+    points.reserve(count);
+    SpatialHash hash(points);
+    uint64_t next_block = 0;
+
+    // Every round draws a batch of blocks in parallel, then accepts their candidates in block order
+    while (static_cast<int>(points.size()) < count && next_block < max_blocks) {
+        const uint64_t remaining = static_cast<uint64_t>(count) - points.size();
+        uint64_t round_blocks = std::max<uint64_t>(num_threads, remaining / SAMPLE_BLOCK_SIZE + 1);
+        round_blocks = std::min(round_blocks, max_blocks - next_block);
+
+        std::vector<std::vector<std::pair<double, double>>> candidates(round_blocks);
+        std::atomic<uint64_t> cursor{0};
+        auto worker = [&]() {
+            for (uint64_t b = cursor++; b < round_blocks; b = cursor++) {
+                sample_block(area, seed, next_block + b, candidates[b]);
+            }
+        };
+        std::vector<std::thread> threads;
+        for (int i = 1; i < std::min<int>(num_threads, static_cast<int>(round_blocks)); ++i) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto &t : threads) {
+            t.join();
+        }
+        next_block += round_blocks;
+
+        for (const auto &block : candidates) {
+            for (const auto &p : block) {
+                if (static_cast<int>(points.size()) >= count) break;
+                if (hash.has_near(p.first, p.second)) continue;
+                points.push_back(p);
+                hash.insert(static_cast<int>(points.size()) - 1);
+            }
+        }
+    }
+
+    return next_block * SAMPLE_BLOCK_SIZE;
+}
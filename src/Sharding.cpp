@@ -0,0 +1,282 @@
+// std libs
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <spawn.h>
+#include <unistd.h>
+
+#include "MatrixFile.h"
+#include "Sharding.h"
+
+extern char **environ;
+
+// ++++++++++++++++++++++++++++++++++++++ FUNCTIONS ++++++++++++++++++++++++++++++++++++++
+
+namespace {
+
+namespace fs = std::filesystem;
+
+std::string shard_name(int index) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "shard_%04d", index);
+    return name;
+}
+
+// Write `content` to `path` through a temporary file, so readers never see a partial file
+bool write_file_atomic(const fs::path &path, const std::string &content) {
+    const fs::path tmp = path.string() + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary);
+        if (!out.is_open()) return false;
+        out << content;
+        if (!out.good()) return false;
+    }
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+    return !ec;
+}
+
+// Append the rows of the raw matrix file `part` to `out`, checking it matches `header`
+bool append_matrix_rows(const fs::path &part, std::ofstream &out, matrix_file_header &header, bool first) {
+    std::ifstream in(part, std::ios::binary);
+    matrix_file_header h;
+    in.read(reinterpret_cast<char *>(&h), sizeof(h));
+    if (!in) return false;
+    if (h.flags != 0) {
+        std::cerr << "Only raw square-layout matrix files can be merged: " << part << std::endl;
+        return false;
+    }
+    if (first) header = h;
+    else if (h.cols != header.cols || h.bits != header.bits || h.unit != header.unit) {
+        std::cerr << "Shard matrix " << part << " doesn't match the other shards." << std::endl;
+        return false;
+    }
+    else header.rows += h.rows;
+    if (in.peek() != std::ifstream::traits_type::eof()) out << in.rdbuf(); // an empty shard has no rows
+    return true;
+}
+
+} // namespace
+
+std::string shard_output_dir(const std::string &dir, int index) {
+    return (fs::path(dir) / shard_name(index)).string();
+}
+
+bool write_shard_job(const std::string &dir, const std::vector<std::string> &args,
+                     const std::vector<std::pair<double, double>> &coordinates, const std::vector<char> &flagged, int shards) {
+    try {
+        fs::create_directories(dir);
+        // Leftovers of a previous run would be claimed or merged
+        for (const auto &entry : fs::directory_iterator(dir)) {
+            const std::string name = entry.path().filename().string();
+            if (name.compare(0, 6, "shard_") == 0 || name == "job.args" || name == "coordinates.f64" || name == "flagged.u8") fs::remove_all(entry.path());
+        }
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Failed to prepare shard directory " << dir << " -> " << e.what() << std::endl;
+        return false;
+    }
+
+    {
+        std::ofstream out(fs::path(dir) / "coordinates.f64", std::ios::binary);
+        for (const auto &c : coordinates) {
+            const double values[2] = {c.first, c.second};
+            out.write(reinterpret_cast<const char *>(values), sizeof(values));
+        }
+        if (!out.good()) {
+            std::cerr << "Failed to write the shard coordinates in " << dir << std::endl;
+            return false;
+        }
+    }
+
+    if (!flagged.empty() && !write_file_atomic(fs::path(dir) / "flagged.u8", std::string(flagged.begin(), flagged.end()))) {
+        std::cerr << "Failed to write the snap flags in " << dir << std::endl;
+        return false;
+    }
+
+    std::string content;
+    for (const auto &arg : args) content += arg + "\n";
+    content += "--coordinates-path\n" + (fs::absolute(dir) / "coordinates.f64").string() + "\n--coordinates-format\nf64\n";
+    if (!write_file_atomic(fs::path(dir) / "job.args", content)) {
+        std::cerr << "Failed to write the shard job arguments in " << dir << std::endl;
+        return false;
+    }
+
+    // Equal row shards, the first ones take the remainder
+    const int n = static_cast<int>(coordinates.size());
+    int first_row = 0;
+    for (int k = 0; k < shards; ++k) {
+        const int rows = n / shards + (k < n % shards ? 1 : 0);
+        if (!write_file_atomic(fs::path(dir) / (shard_name(k) + ".todo"), std::to_string(first_row) + " " + std::to_string(rows) + "\n")) {
+            std::cerr << "Failed to write shard " << k << " in " << dir << std::endl;
+            return false;
+        }
+        first_row += rows;
+    }
+    return true;
+}
+
+bool read_shard_job_args(const std::string &dir, std::vector<std::string> &args) {
+    std::ifstream in(fs::path(dir) / "job.args");
+    if (!in.is_open()) {
+        std::cerr << "No shard job found in " << dir << std::endl;
+        return false;
+    }
+    args.clear();
+    std::string line;
+    while (std::getline(in, line)) args.push_back(line);
+    return true;
+}
+
+bool read_shard_flags(const std::string &dir, int n, std::vector<char> &flagged) {
+    flagged.clear();
+    const fs::path path = fs::path(dir) / "flagged.u8";
+    if (!fs::exists(path)) return true;
+    std::ifstream in(path, std::ios::binary);
+    flagged.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    if (static_cast<int>(flagged.size()) != n) {
+        std::cerr << "The snap flags in " << path.string() << " don't match the " << n << " locations of the job." << std::endl;
+        flagged.clear();
+        return false;
+    }
+    return true;
+}
+
+bool claim_shard(const std::string &dir, shard_spec &spec, std::string &claimPath) {
+    std::vector<fs::path> open_shards;
+    std::error_code ec;
+    for (const auto &entry : fs::directory_iterator(dir, ec)) {
+        if (entry.path().extension() == ".todo") open_shards.push_back(entry.path());
+    }
+    std::sort(open_shards.begin(), open_shards.end());
+
+    char host[256] = "localhost";
+    gethostname(host, sizeof(host) - 1);
+    for (const auto &todo : open_shards) {
+        const std::string name = todo.stem().string(); // shard_NNNN
+        const fs::path claim = fs::path(dir) / (name + ".claimed." + host + "." + std::to_string(getpid()));
+        // Rename is atomic: exactly one worker wins, the others move on to the next shard
+        fs::rename(todo, claim, ec);
+        if (ec) continue;
+
+        spec.index = std::stoi(name.substr(6));
+        std::ifstream in(claim);
+        if (!(in >> spec.first_row >> spec.rows)) {
+            std::cerr << "Malformed shard spec " << claim << std::endl;
+            fail_shard(dir, spec.index, claim.string(), "malformed shard spec");
+            continue;
+        }
+        claimPath = claim.string();
+        return true;
+    }
+    return false;
+}
+
+bool finish_shard(const std::string &dir, const shard_spec &spec, const std::string &claimPath) {
+    std::error_code ec;
+    fs::rename(claimPath, fs::path(dir) / (shard_name(spec.index) + ".done"), ec);
+    return !ec;
+}
+
+bool fail_shard(const std::string &dir, int index, const std::string &claimPath, const std::string &reason) {
+    if (!write_file_atomic(fs::path(dir) / (shard_name(index) + ".failed"), reason + "\n")) {
+        std::cerr << "Failed to mark shard " << index << " as failed in " << dir << std::endl;
+        return false;
+    }
+    std::error_code ec;
+    fs::remove(claimPath, ec);
+    return true;
+}
+
+std::vector<std::pair<int, std::string>> failed_shards(const std::string &dir, int shards) {
+    std::vector<std::pair<int, std::string>> failed;
+    for (int k = 0; k < shards; ++k) {
+        std::ifstream in(fs::path(dir) / (shard_name(k) + ".failed"));
+        if (!in.is_open()) continue;
+        std::string reason;
+        std::getline(in, reason);
+        failed.emplace_back(k, reason);
+    }
+    return failed;
+}
+
+int count_done_shards(const std::string &dir, int shards) {
+    int done = 0;
+    for (int k = 0; k < shards; ++k) done += fs::exists(fs::path(dir) / (shard_name(k) + ".done"));
+    return done;
+}
+
+bool spawn_process(const std::string &executable, const std::vector<std::string> &args, pid_t &pid) {
+    std::vector<char *> argv;
+    argv.push_back(const_cast<char *>(executable.c_str()));
+    for (const auto &arg : args) argv.push_back(const_cast<char *>(arg.c_str()));
+    argv.push_back(nullptr);
+    const int rc = posix_spawn(&pid, executable.c_str(), nullptr, nullptr, argv.data(), environ);
+    if (rc != 0) {
+        std::cerr << "Failed to start " << executable << ": " << std::strerror(rc) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool merge_shard_outputs(const std::string &dir, int shards, const std::string &outputDir) {
+    // Every shard writes the same set of files, take the list from the first one
+    std::vector<fs::path> files;
+    const fs::path first = shard_output_dir(dir, 0);
+    std::error_code ec;
+    for (const auto &entry : fs::recursive_directory_iterator(first, ec)) {
+        const auto extension = entry.path().extension();
+        if (entry.is_regular_file() && (extension == ".csv" || extension == ".mtx")) files.push_back(fs::relative(entry.path(), first));
+    }
+    std::sort(files.begin(), files.end());
+    if (files.empty()) {
+        std::cerr << "No shard outputs found in " << first << std::endl;
+        return false;
+    }
+
+    bool ok = true;
+    for (const auto &file : files) {
+        const fs::path target = fs::path(outputDir) / file;
+        fs::create_directories(target.parent_path(), ec);
+        std::ofstream out(target, std::ios::binary);
+        if (!out.is_open()) {
+            std::cerr << "Failed to open output file: " << target << std::endl;
+            ok = false;
+            continue;
+        }
+
+        const bool matrix = file.extension() == ".mtx";
+        matrix_file_header header;
+        if (matrix) out.write(reinterpret_cast<const char *>(&header), sizeof(header)); // rewritten below
+
+        bool file_ok = true;
+        for (int k = 0; k < shards && file_ok; ++k) {
+            const fs::path part = fs::path(shard_output_dir(dir, k)) / file;
+            if (matrix) {
+                file_ok = append_matrix_rows(part, out, header, k == 0);
+            }
+            else {
+                std::ifstream in(part, std::ios::binary);
+                file_ok = in.is_open();
+                if (file_ok && in.peek() != std::ifstream::traits_type::eof()) out << in.rdbuf();
+            }
+            if (!file_ok) std::cerr << "Missing or invalid shard output " << part << std::endl;
+        }
+
+        if (matrix && file_ok) {
+            out.seekp(0);
+            out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        }
+        out.close();
+        if (file_ok && out.good()) std::cout << " - Merged " << shards << " shards into: " << target.string() << std::endl;
+        ok = ok && file_ok;
+    }
+    return ok;
+}
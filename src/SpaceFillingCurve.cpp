@@ -0,0 +1,84 @@
+// std libs
+#include <algorithm>
+#include <utility>
+
+#include "SpaceFillingCurve.h"
+
+// ********************************* LOCAL PARAMETERS ************************************
+// Bits per axis of the curve grid
+#define CURVE_BITS 24
+
+// ++++++++++++++++++++++++++++++++++++++ FUNCTIONS ++++++++++++++++++++++++++++++++++++++
+
+bool parse_curve(const std::string &name, curve_type &curve) {
+    if (name == "none") curve = curve_type::None;
+    else if (name == "hilbert") curve = curve_type::Hilbert;
+    else if (name == "morton") curve = curve_type::Morton;
+    else return false;
+    return true;
+}
+
+const char *curve_name(curve_type curve) {
+    return curve == curve_type::Hilbert ? "hilbert" : curve == curve_type::Morton ? "morton" : "none";
+}
+
+namespace {
+
+// Grid cell of a coordinate in [low, high], clamped to the grid
+uint32_t grid_cell(double value, double low, double high) {
+    const double cells = static_cast<double>(1u << CURVE_BITS);
+    const double cell = (value - low) / (high - low) * cells;
+    return static_cast<uint32_t>(std::clamp(cell, 0.0, cells - 1));
+}
+
+// Spread the low 32 bits of `v` to the even bits of the result
+uint64_t spread_bits(uint64_t v) {
+    v &= 0xffffffffull;
+    v = (v | (v << 16)) & 0x0000ffff0000ffffull;
+    v = (v | (v << 8)) & 0x00ff00ff00ff00ffull;
+    v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0full;
+    v = (v | (v << 2)) & 0x3333333333333333ull;
+    v = (v | (v << 1)) & 0x5555555555555555ull;
+    return v;
+}
+
+// Distance along the Hilbert curve of the cell (x, y) of a 2^CURVE_BITS grid
+uint64_t hilbert_index(uint32_t x, uint32_t y) {
+    uint64_t d = 0;
+    for (uint32_t s = 1u << (CURVE_BITS - 1); s > 0; s >>= 1) {
+        const uint32_t rx = (x & s) ? 1 : 0;
+        const uint32_t ry = (y & s) ? 1 : 0;
+        d += static_cast<uint64_t>(s) * s * ((3 * rx) ^ ry);
+        // Rotate the quadrant so the sub-curve connects to its neighbours
+        if (ry == 0) {
+            if (rx == 1) {
+                x = s - 1 - (x & (s - 1));
+                y = s - 1 - (y & (s - 1));
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+} // namespace
+
+uint64_t curve_key(curve_type curve, double longitude, double latitude) {
+    if (curve == curve_type::None) return 0;
+    const uint32_t x = grid_cell(longitude, -180.0, 180.0);
+    const uint32_t y = grid_cell(latitude, -90.0, 90.0);
+    if (curve == curve_type::Morton) return spread_bits(x) | (spread_bits(y) << 1);
+    return hilbert_index(x, y);
+}
+
+std::vector<int> curve_order(curve_type curve, double **coordinates, int n) {
+    std::vector<int> order(n);
+    for (int i = 0; i < n; ++i) order[i] = i;
+    if (curve == curve_type::None) return order;
+
+    std::vector<std::pair<uint64_t, int>> keys(n);
+    for (int i = 0; i < n; ++i) keys[i] = {curve_key(curve, coordinates[i][0], coordinates[i][1]), i};
+    std::sort(keys.begin(), keys.end());
+    for (int i = 0; i < n; ++i) order[i] = keys[i].second;
+    return order;
+}
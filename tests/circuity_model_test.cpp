@@ -0,0 +1,82 @@
+// CircuityModel (CircuityModel.h) on hand-made samples, without OSRM: distance bands, per stratum fits,
+// the band fallback of strata with too few samples and the estimates. Returns non-zero if any check fails.
+
+// std libs
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "CircuityModel.h"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition, what)                                                                              \
+    do {                                                                                                    \
+        if (!(condition)) {                                                                                 \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " << what << " (" #condition ")" << std::endl;   \
+            ++failures;                                                                                     \
+        }                                                                                                   \
+    } while (0)
+
+void check_bands() {
+    CHECK(CircuityModel::band(0) == 0, "band of 0 m");
+    CHECK(CircuityModel::band(499.9) == 0, "band below the first edge");
+    CHECK(CircuityModel::band(500) == 1, "an edge starts the next band");
+    CHECK(CircuityModel::band(1500) == 2, "band of 1.5 km");
+    CHECK(CircuityModel::band(500000) == CIRCUITY_BANDS - 1, "last edge");
+    CHECK(CircuityModel::band(1e7) == CIRCUITY_BANDS - 1, "open ended last band");
+}
+
+void check_fit() {
+    // Two pairs of nearby locations in opposite corners of a 2 x 2 grid
+    double locations[4][2] = {{4.0, 50.0}, {4.01, 50.0}, {5.0, 51.0}, {5.0, 50.99}};
+    double *coordinates[4] = {locations[0], locations[1], locations[2], locations[3]};
+    CircuityModel model(coordinates, 4, 2);
+    CHECK(model.strata() == 4 * CIRCUITY_BANDS, "strata of a 2 x 2 grid");
+
+    const double s01 = model.straight(0, 1), s23 = model.straight(2, 3);
+    CHECK(std::abs(s01 - 715) < 5, "haversine of 0.01 degree longitude at 50N: " << s01);
+    CHECK(std::abs(s23 - 1112) < 5, "haversine of 0.01 degree latitude: " << s23);
+    CHECK(model.stratum(0, s01) != model.stratum(2, s23), "opposite corners are different strata");
+    CHECK(model.stratum(0, s01) == model.stratum(1, s01), "same cell and band are the same stratum");
+
+    CHECK(model.fit({}) == -1, "no samples");
+    CHECK(model.fit({{0, 0.5, 10, 10}}) == -1, "pairs closer than a meter are ignored");
+
+    // Enough samples for the stratum of 0 -> 1 (circuity 1.2, pace 0.1 s/m, i.e. 36 km/h), too few for 2 -> 3
+    std::vector<circuity_sample> samples;
+    for (int k = 0; k < CIRCUITY_MIN_SAMPLES + 2; ++k) samples.push_back({0, s01, s01 * 1.2, s01 * 0.1});
+    for (int k = 0; k < 3; ++k) samples.push_back({2, s23, s23 * 2.0, s23 * 0.3});
+    CHECK(model.fit(samples) == 1, "only one stratum has enough samples");
+    CHECK(std::abs(model.median_circuity() - 1.2) < 1e-9, "median circuity");
+    CHECK(std::abs(model.median_pace() - 0.1) < 1e-9, "median pace");
+
+    int distance = 0, time = 0;
+    model.estimate(0, 1, distance, time);
+    CHECK(distance == static_cast<int>(s01 * 1.2 + 0.5) && time == static_cast<int>(s01 * 0.1 + 0.5), "estimate of a fitted stratum");
+
+    // Band 2 has only 3 samples, so the stratum of 2 -> 3 takes the factors of the nearest band with enough (band 1)
+    model.estimate(2, 3, distance, time);
+    CHECK(distance == static_cast<int>(s23 * 1.2 + 0.5) && time == static_cast<int>(s23 * 0.1 + 0.5), "estimate from the nearest fitted band");
+
+    // With enough samples the stratum gets its own factors
+    for (int k = 0; k < CIRCUITY_MIN_SAMPLES; ++k) samples.push_back({2, s23, s23 * 2.0, s23 * 0.3});
+    CHECK(model.fit(samples) == 2, "both strata fitted");
+    model.estimate(2, 3, distance, time);
+    CHECK(distance == static_cast<int>(s23 * 2.0 + 0.5) && time == static_cast<int>(s23 * 0.3 + 0.5), "estimate of the second fitted stratum");
+}
+
+} // namespace
+
+int main() {
+    check_bands();
+    check_fit();
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << " - Circuity model checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,186 @@
+// Round trip of TravelMatrix through the matrix file format (MatrixFile.h), without OSRM: square, shard
+// (rows < cols) and triangle matrices at 16, 24 and 32 bits with unset and overflowing cells, written raw and
+// (if the build has zstd) compressed, and read back row by row; corrupt headers and block offsets must be
+// rejected by MatrixFileReader::open. Returns non-zero if any check fails.
+
+// std libs
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "MatrixFile.h"
+#include "TravelMatrix.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition, what)                                                                              \
+    do {                                                                                                    \
+        if (!(condition)) {                                                                                 \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " << what << " (" #condition ")" << std::endl;   \
+            ++failures;                                                                                     \
+        }                                                                                                   \
+    } while (0)
+
+// Fill `matrix` with random values: every 7th cell stays unset and every 11th overflows the encoding.
+// `expected` gets the value get() must return for every cell (row-major, both halves for a triangle).
+void fill(TravelMatrix &matrix, uint64_t seed, std::vector<int> &expected) {
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<int> pick(0, 20000);
+    const int rows = matrix.rows(), cols = matrix.cols();
+    const double unit = matrix.encoding().unit;
+    expected.assign(static_cast<size_t>(rows) * cols, TravelMatrix::UNSET);
+    uint64_t overflows = 0;
+    for (int i = 0; i < rows; ++i) {
+        for (int j = matrix.triangle() ? i : 0; j < cols; ++j) {
+            const int cell = i * cols + j;
+            int value;
+            if (cell % 7 == 3) continue;
+            if (cell % 11 == 5) {
+                matrix.set(i, j, matrix.max_value() * 4);
+                value = static_cast<int>((matrix.unset_code() - 1) * unit);
+                ++overflows;
+            }
+            else {
+                const int set = pick(rng);
+                matrix.set(i, j, set);
+                value = static_cast<int>(static_cast<int>(set / unit) * unit);
+            }
+            expected[cell] = value;
+            if (matrix.triangle()) expected[static_cast<size_t>(j) * cols + i] = value;
+        }
+    }
+    CHECK(matrix.overflow_count() == overflows, "overflow count");
+}
+
+// The packed triangle stores row i from the diagonal on, (j, i) and (i, j) are the same cell
+void check_triangle_offsets(const TravelMatrix &matrix) {
+    const size_t n = matrix.rows(), cell_bytes = matrix.encoding().bits / 8;
+    for (size_t i = 0; i < n; ++i) {
+        CHECK(matrix.row_begin(static_cast<int>(i)) == (i * n - i * (i - 1) / 2) * cell_bytes, "triangle row " << i << " offset");
+    }
+    CHECK(matrix.row_begin(static_cast<int>(n)) == matrix.bytes(), "triangle end offset");
+    CHECK(matrix.bytes() == n * (n + 1) / 2 * cell_bytes, "triangle size");
+    for (int i = 0; i < static_cast<int>(n); ++i) {
+        for (int j = 0; j < i; ++j) CHECK(matrix.code(i, j) == matrix.code(j, i), "triangle cell " << i << "," << j);
+    }
+}
+
+void round_trip(int rows, int cols, bool triangle, const matrix_encoding &encoding, bool compressed, const fs::path &dir) {
+    const std::string name = std::to_string(rows) + "x" + std::to_string(cols) + (triangle ? " triangle " : " ") + std::to_string(encoding.bits) +
+                             " bits" + (compressed ? " compressed" : " raw");
+    TravelMatrix matrix;
+    CHECK(matrix.allocate(rows, cols, encoding, triangle), name << ": allocate");
+    std::vector<int> expected;
+    fill(matrix, static_cast<uint64_t>(rows) * 1000 + encoding.bits, expected);
+    if (triangle) check_triangle_offsets(matrix);
+
+    std::vector<int> row(cols);
+    for (int i = 0; i < rows; ++i) {
+        matrix.get_row(i, row.data());
+        for (int j = 0; j < cols; ++j) CHECK(row[j] == expected[static_cast<size_t>(i) * cols + j], name << ": matrix cell " << i << "," << j);
+    }
+
+    const std::string filename = (dir / "matrix.mtx").string();
+    if (compressed && !matrix_file_compression_available()) {
+        CHECK(!write_matrix_file(filename, matrix, true), name << ": write without zstd must fail");
+        return;
+    }
+    CHECK(write_matrix_file(filename, matrix, compressed), name << ": write");
+
+    MatrixFileReader reader;
+    if (!reader.open(filename)) {
+        CHECK(false, name << ": open");
+        return;
+    }
+    const matrix_file_header &header = reader.header();
+    CHECK(std::string(header.magic, 8) == "OSRMMAT1", name << ": magic");
+    CHECK(reader.rows() == rows && reader.cols() == cols, name << ": dimensions");
+    CHECK(header.bits == static_cast<uint32_t>(encoding.bits) && header.unit == encoding.unit, name << ": encoding");
+    CHECK(((header.flags & MATRIX_FILE_TRIANGLE) != 0) == triangle, name << ": triangle flag");
+    CHECK(((header.flags & MATRIX_FILE_COMPRESSED) != 0) == compressed, name << ": compressed flag");
+    CHECK(header.block_rows == (compressed ? 64u : 0u), name << ": block rows");
+    if (!compressed) CHECK(fs::file_size(filename) == sizeof(matrix_file_header) + matrix.bytes(), name << ": raw file size");
+
+    // Rows in reverse order, so compressed blocks are loaded out of order
+    for (int i = rows - 1; i >= 0; --i) {
+        CHECK(reader.read_row(i, row), name << ": read row " << i);
+        for (int j = 0; j < cols; ++j) CHECK(row[j] == expected[static_cast<size_t>(i) * cols + j], name << ": file cell " << i << "," << j);
+    }
+}
+
+// Write a 100 x 100 matrix, let `corrupt` patch the file and check that the reader refuses it
+template <typename Patch>
+void check_rejected(const std::string &name, bool compressed, const fs::path &dir, Patch corrupt) {
+    if (compressed && !matrix_file_compression_available()) return;
+    TravelMatrix matrix;
+    matrix.allocate(100, 100, matrix_encoding());
+    std::vector<int> expected;
+    fill(matrix, 7, expected);
+    const std::string filename = (dir / "corrupt.mtx").string();
+    CHECK(write_matrix_file(filename, matrix, compressed), name << ": write");
+    {
+        std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+        corrupt(file);
+    }
+    MatrixFileReader reader;
+    CHECK(!reader.open(filename), name << ": corrupt file opened");
+}
+
+template <typename T>
+void patch(std::fstream &file, std::streamoff at, T value) {
+    file.seekp(at);
+    file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void check_corrupt_files(const fs::path &dir) {
+    const std::streamoff offsets = sizeof(matrix_file_header);
+    check_rejected("truncated header", false, dir, [&](std::fstream &) { fs::resize_file(dir / "corrupt.mtx", offsets - 4); });
+    check_rejected("non-square triangle", false, dir, [](std::fstream &file) {
+        patch(file, offsetof(matrix_file_header, rows), uint32_t(50));
+        patch(file, offsetof(matrix_file_header, flags), MATRIX_FILE_TRIANGLE);
+    });
+    check_rejected("zero block rows", true, dir, [](std::fstream &file) { patch(file, offsetof(matrix_file_header, block_rows), uint32_t(0)); });
+    check_rejected("huge row count", true, dir, [](std::fstream &file) {
+        patch(file, offsetof(matrix_file_header, rows), uint32_t(0xFFFFFFFF));
+        patch(file, offsetof(matrix_file_header, block_rows), uint32_t(1));
+    });
+    // 100 rows in 64 row blocks: offsets[0..2]
+    check_rejected("decreasing offsets", true, dir, [&](std::fstream &file) { patch(file, offsets + 8, uint64_t(1) << 40); });
+    check_rejected("offsets past the end", true, dir, [&](std::fstream &file) { patch(file, offsets + 16, uint64_t(1) << 40); });
+    check_rejected("offsets not starting at 0", true, dir, [&](std::fstream &file) { patch(file, offsets, uint64_t(1)); });
+}
+
+} // namespace
+
+int main() {
+    const fs::path dir = fs::temp_directory_path() / ("matrix_file_test_" + std::to_string(std::random_device{}()));
+    fs::create_directories(dir);
+
+    // 16 bits with a coarse unit overflows above 655340, 24 and 32 bits store every second
+    const matrix_encoding encodings[] = {{16, 10.0}, {24, 1.0}, {32, 1.0}};
+    for (const auto &encoding : encodings) {
+        for (bool compressed : {false, true}) {
+            round_trip(150, 150, false, encoding, compressed, dir);
+            round_trip(70, 150, false, encoding, compressed, dir);
+            round_trip(150, 150, true, encoding, compressed, dir);
+            round_trip(1, 1, true, encoding, compressed, dir);
+        }
+    }
+    check_corrupt_files(dir);
+    fs::remove_all(dir);
+
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << " - Matrix file round trips passed" << (matrix_file_compression_available() ? "" : " (no zstd, compressed files skipped)") << std::endl;
+    return 0;
+}
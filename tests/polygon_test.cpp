@@ -0,0 +1,100 @@
+// MultiPolygon::contains (latitude band index, Polygon.h) against the reference contains_linear ray cast on
+// many-vertex areas, without OSRM: a jagged star with a hole next to a second polygon, and a comb of long
+// teeth whose steep edges force the index to halve its bands (MAX_EDGE_COPIES). Returns non-zero if any check fails.
+
+// std libs
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Polygon.h"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition, what)                                                                              \
+    do {                                                                                                    \
+        if (!(condition)) {                                                                                 \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " << what << " (" #condition ")" << std::endl;   \
+            ++failures;                                                                                     \
+        }                                                                                                   \
+    } while (0)
+
+// Ring of `n` vertices around (lon, lat) with a radius that jumps randomly between 0.5 and 1 times `radius`
+Ring jagged_ring(double lon, double lat, double radius, int n, std::mt19937_64 &rng) {
+    std::uniform_real_distribution<double> scale(0.5, 1.0);
+    Ring ring;
+    for (int k = 0; k < n; ++k) {
+        const double angle = 2 * M_PI * k / n, r = radius * scale(rng);
+        ring.emplace_back(lon + r * std::cos(angle), lat + r * std::sin(angle));
+    }
+    ring.push_back(ring.front());
+    return ring;
+}
+
+// Comb: a base bar along the bottom with `teeth` thin teeth over the full height
+Ring comb_ring(int teeth) {
+    Ring ring = {{0.0, 0.0}, {1.0, 0.0}};
+    const double width = 1.0 / teeth;
+    for (int t = teeth - 1; t >= 0; --t) {
+        ring.emplace_back((t + 1) * width, 1.0);
+        ring.emplace_back((t + 0.5) * width, 1.0);
+        ring.emplace_back((t + 0.5) * width, 0.05);
+        ring.emplace_back(t * width, 0.05);
+    }
+    ring.push_back(ring.front());
+    return ring;
+}
+
+// Compare both containment tests on random points around the area and on every vertex latitude
+void compare(const std::string &name, MultiPolygon &area, std::mt19937_64 &rng) {
+    area.update_bounds();
+    CHECK(!area.band_offsets.empty(), name << ": band index built");
+    const double margin = 0.1 * (area.lat_max - area.lat_min);
+    std::uniform_real_distribution<double> lon(area.lon_min - margin, area.lon_max + margin), lat(area.lat_min - margin, area.lat_max + margin);
+
+    int mismatches = 0, inside = 0;
+    auto check = [&](double x, double y) {
+        const bool banded = area.contains(x, y);
+        if (banded != area.contains_linear(x, y) && ++mismatches <= 5) CHECK(false, name << ": point " << x << " " << y);
+        inside += banded;
+    };
+    for (int k = 0; k < 20000; ++k) check(lon(rng), lat(rng));
+    for (const auto &polygon : area.polygons) {
+        for (const auto &ring : polygon) {
+            for (const auto &vertex : ring) check(lon(rng), vertex.second);
+        }
+    }
+    CHECK(mismatches == 0, name << ": " << mismatches << " mismatches");
+    CHECK(inside > 0, name << ": some points inside");
+}
+
+} // namespace
+
+int main() {
+    std::mt19937_64 rng(42);
+
+    // Jagged star with a jagged hole, and a second polygon to the east
+    MultiPolygon star;
+    star.polygons.push_back({jagged_ring(4.0, 50.0, 1.0, 20000, rng), jagged_ring(4.0, 50.0, 0.3, 2000, rng)});
+    star.polygons.push_back({jagged_ring(6.5, 50.2, 0.8, 5000, rng)});
+    compare("star", star, rng);
+
+    // Every tooth edge spans almost the full height: the index must halve its bands to bound the copies
+    MultiPolygon comb;
+    comb.polygons.push_back({comb_ring(2000)});
+    compare("comb", comb, rng);
+    const size_t edges = 2 * 2000 + 2; // Non-horizontal edges: two per tooth and the ends of the base bar
+    CHECK(comb.band_offsets.size() - 1 < edges / 4, "comb: band count reduced");
+    CHECK(comb.band_edges.size() <= 8 * edges, "comb: at most MAX_EDGE_COPIES copies per edge");
+
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << " - Polygon containment checks passed" << std::endl;
+    return 0;
+}